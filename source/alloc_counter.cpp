@@ -0,0 +1,45 @@
+#include "alloc_counter.h"
+
+#ifdef BREAKOUT_COUNT_ALLOCATIONS
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<uint64_t> allocations(0);
+
+// the nothrow and array forms forward to these, so counting here sees every allocation
+void *operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+bool AllocationCounter::Enabled() {
+    return true;
+}
+
+uint64_t AllocationCounter::Count() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+#else
+
+bool AllocationCounter::Enabled() {
+    return false;
+}
+
+uint64_t AllocationCounter::Count() {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <cstdint>
+
+
+// Counts calls to the global operator new. The counting replacement is only
+// linked in when built with BREAKOUT_COUNT_ALLOCATIONS, otherwise Count stays 0.
+class AllocationCounter {
+public:
+    static bool     Enabled();
+    static uint64_t Count();
+};
+
+#endif
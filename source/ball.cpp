@@ -4,7 +4,7 @@
 
 
 BallObject::BallObject() 
-    : GameObject(), Radius(12.5f), Stuck(true) {}
+    : GameObject(), Radius(12.5f), Stuck(true), Sticky(false), PassThrough(false) {}
 
 BallObject::BallObject(glm::vec2 pos, float radius, glm::vec2 velocity, Texture2D sprite)
     : GameObject(pos, glm::vec2(radius * 2.0f, radius * 2.0f), sprite, glm::vec3(1.0f), velocity),
@@ -34,6 +34,7 @@ glm::vec2 BallObject::Move(float dt, unsigned int window_width) {
 
 void BallObject::Reset(glm::vec2 position, glm::vec2 velocity) {
     this->Position = position;
+    this->PrevPosition = position;
     this->Velocity = velocity;
     this->Stuck = true;
 }
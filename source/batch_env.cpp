@@ -0,0 +1,83 @@
+#include "batch_env.h"
+
+// envs per scheduled chunk, large enough to amortize the dispatch
+const unsigned int kEnvGrain = 64;
+
+
+BatchEnv::BatchEnv(unsigned int count, unsigned int threads, unsigned int width, unsigned int height, float tickTime, uint64_t seed)
+    : Observations(count * kObservationSize), Rewards(count), Dones(count), pool(threads), tickTime(tickTime) {
+    this->games.reserve(count);
+    for (unsigned int i = 0; i < count; ++i)
+        this->games.emplace_back(width, height, seed + i);
+
+    this->pool.ParallelFor(count, kEnvGrain, [this](unsigned int begin, unsigned int end) {
+        for (unsigned int i = begin; i < end; ++i) {
+            this->games[i].Init(true);
+            this->observe(i);
+        }
+    });
+}
+
+
+void BatchEnv::Reset() {
+    this->pool.ParallelFor(this->Count(), kEnvGrain, [this](unsigned int begin, unsigned int end) {
+        for (unsigned int i = begin; i < end; ++i) {
+            this->games[i].ResetLevel();
+            this->games[i].ResetPlayer();
+            this->Rewards[i] = 0.0f;
+            this->Dones[i] = 0;
+            this->observe(i);
+        }
+    });
+}
+
+
+void BatchEnv::Step(const int *actions) {
+    this->pool.ParallelFor(this->Count(), kEnvGrain, [this, actions](unsigned int begin, unsigned int end) {
+        this->stepRange(actions, begin, end);
+    });
+}
+
+
+void BatchEnv::stepRange(const int *actions, unsigned int begin, unsigned int end) {
+    for (unsigned int i = begin; i < end; ++i) {
+        Game &game = this->games[i];
+        unsigned int score = game.Score;
+        unsigned int ballsLost = game.BallsLost;
+
+        game.Keys[GLFW_KEY_LEFT] = actions[i] == ACTION_LEFT;
+        game.Keys[GLFW_KEY_RIGHT] = actions[i] == ACTION_RIGHT;
+        game.Keys[GLFW_KEY_SPACE] = actions[i] == ACTION_LAUNCH;
+        game.Step(this->tickTime);
+
+        // +1 per brick, -1 for dropping the ball; losing the ball already
+        // resets the game, clearing the level has to be done here
+        bool lost = game.BallsLost != ballsLost;
+        bool cleared = !lost && game.Levels[game.Level].IsCompleted();
+        if (cleared) {
+            game.ResetLevel();
+            game.ResetPlayer();
+        }
+
+        this->Rewards[i] = (float)(game.Score - score) - (lost ? 1.0f : 0.0f);
+        this->Dones[i] = lost || cleared;
+        this->observe(i);
+    }
+}
+
+
+void BatchEnv::observe(unsigned int i) {
+    const Game &game = this->games[i];
+    float *obs = &this->Observations[i * kObservationSize];
+    float width = (float)game.Width;
+    float height = (float)game.Height;
+
+    obs[0] = game.Ball.Position.x / width;
+    obs[1] = game.Ball.Position.y / height;
+    obs[2] = game.Ball.Velocity.x / width;
+    obs[3] = game.Ball.Velocity.y / width;
+    obs[4] = game.Player.Position.x / width;
+    obs[5] = game.Player.Size.x / width;
+    obs[6] = game.Ball.Stuck ? 1.0f : 0.0f;
+    obs[7] = game.Ball.PassThrough ? 1.0f : 0.0f;
+}
@@ -0,0 +1,52 @@
+#ifndef BATCH_ENV_H
+#define BATCH_ENV_H
+
+#include <vector>
+
+#include "game.h"
+#include "thread_pool.h"
+
+
+enum BatchAction {
+    ACTION_NONE,
+    ACTION_LEFT,
+    ACTION_RIGHT,
+    ACTION_LAUNCH
+};
+
+// ball x, y, ball velocity x, y, paddle x, paddle width, ball stuck, ball pass-through;
+// positions are normalized by the screen size, velocities by its width per second
+const unsigned int kObservationSize = 8;
+
+
+// Steps many independent headless games with one call, sharded across a
+// thread pool. The games live in one contiguous array and the results are
+// written to flat per-env arrays: Observations (Count() * kObservationSize),
+// Rewards and Dones. A game that finishes an episode is reset in place.
+class BatchEnv {
+public:
+    std::vector<float>          Observations;
+    std::vector<float>          Rewards;
+    std::vector<unsigned char>  Dones;
+
+    // game i is seeded with seed + i, so a batch is reproducible whatever the thread count
+    BatchEnv(unsigned int count, unsigned int threads, unsigned int width, unsigned int height, float tickTime, uint64_t seed = 0);
+
+    unsigned int Count() const   { return (unsigned int)this->games.size(); }
+    unsigned int Threads() const { return this->pool.Size(); }
+
+    // resets every game and refreshes the observations
+    void Reset();
+    // applies actions[Count()] and advances every game by one tick
+    void Step(const int *actions);
+
+private:
+    std::vector<Game> games;
+    ThreadPool        pool;
+    float             tickTime;
+
+    void stepRange(const int *actions, unsigned int begin, unsigned int end);
+    void observe(unsigned int i);
+};
+
+#endif
@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <cmath>
+
+#include "brick_store.h"
+#include "simd.h"
+
+
+void BrickStore::Clear() {
+    this->X.clear();
+    this->Y.clear();
+    this->W.clear();
+    this->H.clear();
+    this->Colors.clear();
+    this->Solid.clear();
+    this->Destroyed.clear();
+    this->count = 0;
+    this->destructible = this->remaining = 0;
+    this->ClearDirty();
+}
+
+
+unsigned int BrickStore::Add(glm::vec2 position, glm::vec2 size, glm::vec3 color, bool solid) {
+    unsigned int i = this->count++;
+
+    // grow by a full group of lanes, the padding stays destroyed until used
+    if (i % kBrickLanes == 0) {
+        this->X.resize(i + kBrickLanes, 0.0f);
+        this->Y.resize(i + kBrickLanes, 0.0f);
+        this->W.resize(i + kBrickLanes, 0.0f);
+        this->H.resize(i + kBrickLanes, 0.0f);
+        this->Colors.resize(i + kBrickLanes, glm::vec3(1.0f));
+        if (i % 64 == 0) {
+            this->Solid.push_back(0);
+            this->Destroyed.push_back(~uint64_t(0));
+        }
+    }
+
+    this->X[i] = position.x;
+    this->Y[i] = position.y;
+    this->W[i] = size.x;
+    this->H[i] = size.y;
+    this->Colors[i] = color;
+    if (solid)
+        this->Solid[i >> 6] |= uint64_t(1) << (i & 63);
+    else
+        ++this->destructible, ++this->remaining;
+    this->Destroyed[i >> 6] &= ~(uint64_t(1) << (i & 63));
+    this->markDirty(i, i + 1);
+    return i;
+}
+
+
+void BrickStore::Restore() {
+    for (size_t word = 0; word < this->Destroyed.size(); ++word) {
+        unsigned int used = std::min(64u, this->count - (unsigned int)word * 64);
+        this->Destroyed[word] = used == 64 ? 0 : ~uint64_t(0) << used;
+    }
+    this->remaining = this->destructible;
+    this->markDirty(0, this->count);
+}
+
+
+void BrickStore::Destroy(unsigned int i) {
+    if (this->IsDestroyed(i))
+        return;
+    this->Destroyed[i >> 6] |= uint64_t(1) << (i & 63);
+    if (!this->IsSolid(i))
+        --this->remaining;
+    this->markDirty(i, i + 1);
+}
+
+
+// grows the dirty range to cover [begin, end), nearby changes coalesce into one range
+void BrickStore::markDirty(unsigned int begin, unsigned int end) {
+    if (this->dirtyBegin == this->dirtyEnd) {
+        this->dirtyBegin = begin;
+        this->dirtyEnd = end;
+        return;
+    }
+    this->dirtyBegin = std::min(this->dirtyBegin, begin);
+    this->dirtyEnd = std::max(this->dirtyEnd, end);
+}
+
+
+// Same math as CheckCollision(BallObject&, GameObject&): clamp the offset from
+// the brick center to the half extents and compare the distance to the radius.
+unsigned int BrickStore::OverlapMask(glm::vec2 center, float radius, unsigned int first) const {
+    unsigned int mask = 0;
+
+#if defined(BREAKOUT_SIMD_AVX)
+    const __m256 half = _mm256_set1_ps(0.5f);
+    __m256 hx = _mm256_mul_ps(_mm256_loadu_ps(&this->W[first]), half);
+    __m256 hy = _mm256_mul_ps(_mm256_loadu_ps(&this->H[first]), half);
+    __m256 cx = _mm256_add_ps(_mm256_loadu_ps(&this->X[first]), hx);
+    __m256 cy = _mm256_add_ps(_mm256_loadu_ps(&this->Y[first]), hy);
+
+    __m256 dx = _mm256_sub_ps(_mm256_set1_ps(center.x), cx);
+    __m256 dy = _mm256_sub_ps(_mm256_set1_ps(center.y), cy);
+    dx = _mm256_min_ps(_mm256_max_ps(dx, _mm256_sub_ps(_mm256_setzero_ps(), hx)), hx);
+    dy = _mm256_min_ps(_mm256_max_ps(dy, _mm256_sub_ps(_mm256_setzero_ps(), hy)), hy);
+    dx = _mm256_sub_ps(_mm256_add_ps(cx, dx), _mm256_set1_ps(center.x));
+    dy = _mm256_sub_ps(_mm256_add_ps(cy, dy), _mm256_set1_ps(center.y));
+
+    __m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)));
+    mask = (unsigned int)_mm256_movemask_ps(_mm256_cmp_ps(length, _mm256_set1_ps(radius), _CMP_LT_OQ));
+#elif defined(BREAKOUT_SIMD_SSE)
+    const __m128 half = _mm_set1_ps(0.5f);
+    for (unsigned int j = 0; j < kBrickLanes; j += 4) {
+        __m128 hx = _mm_mul_ps(_mm_loadu_ps(&this->W[first + j]), half);
+        __m128 hy = _mm_mul_ps(_mm_loadu_ps(&this->H[first + j]), half);
+        __m128 cx = _mm_add_ps(_mm_loadu_ps(&this->X[first + j]), hx);
+        __m128 cy = _mm_add_ps(_mm_loadu_ps(&this->Y[first + j]), hy);
+
+        __m128 dx = _mm_sub_ps(_mm_set1_ps(center.x), cx);
+        __m128 dy = _mm_sub_ps(_mm_set1_ps(center.y), cy);
+        dx = _mm_min_ps(_mm_max_ps(dx, _mm_sub_ps(_mm_setzero_ps(), hx)), hx);
+        dy = _mm_min_ps(_mm_max_ps(dy, _mm_sub_ps(_mm_setzero_ps(), hy)), hy);
+        dx = _mm_sub_ps(_mm_add_ps(cx, dx), _mm_set1_ps(center.x));
+        dy = _mm_sub_ps(_mm_add_ps(cy, dy), _mm_set1_ps(center.y));
+
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+        mask |= (unsigned int)_mm_movemask_ps(_mm_cmplt_ps(length, _mm_set1_ps(radius))) << j;
+    }
+#else
+    for (unsigned int j = 0; j < kBrickLanes; ++j) {
+        float hx = this->W[first + j] * 0.5f;
+        float hy = this->H[first + j] * 0.5f;
+        float cx = this->X[first + j] + hx;
+        float cy = this->Y[first + j] + hy;
+
+        float dx = cx + glm::clamp(center.x - cx, -hx, hx) - center.x;
+        float dy = cy + glm::clamp(center.y - cy, -hy, hy) - center.y;
+        if (std::sqrt(dx * dx + dy * dy) < radius)
+            mask |= 1u << j;
+    }
+#endif
+
+    // drop destroyed bricks and padding, first is a multiple of 8 so the
+    // group's bits never straddle two words
+    unsigned int dead = (unsigned int)(this->Destroyed[first >> 6] >> (first & 63)) & 0xFF;
+    return mask & ~dead;
+}
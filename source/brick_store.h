@@ -0,0 +1,75 @@
+#ifndef BRICK_STORE_H
+#define BRICK_STORE_H
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+// Structure-of-arrays storage for the bricks of a level. The collision test
+// only reads position, size and flags, so those are kept in packed arrays;
+// color is only read by the renderer. Arrays are padded to a multiple of
+// kBrickLanes with destroyed entries so the kernel never needs a tail loop.
+const unsigned int kBrickLanes = 8;
+
+
+class BrickStore {
+public:
+    std::vector<float>      X, Y, W, H;
+    std::vector<glm::vec3>  Colors;
+    std::vector<uint64_t>   Solid, Destroyed;   // one bit per brick
+
+    BrickStore() : count(0), destructible(0), remaining(0), dirtyBegin(0), dirtyEnd(0) {}
+
+    unsigned int Count() const { return this->count; }
+
+    // destructible bricks in total and still standing, kept up to date by Add and Destroy
+    unsigned int Destructible() const { return this->destructible; }
+    unsigned int Remaining() const    { return this->remaining; }
+
+    void         Clear();
+    unsigned int Add(glm::vec2 position, glm::vec2 size, glm::vec3 color, bool solid);
+
+    bool IsSolid(unsigned int i) const      { return (this->Solid[i >> 6] >> (i & 63)) & 1; }
+    bool IsDestroyed(unsigned int i) const  { return (this->Destroyed[i >> 6] >> (i & 63)) & 1; }
+    void Destroy(unsigned int i);
+    // clears every destroyed bit, the padding past Count stays destroyed
+    void Restore();
+
+    // bricks [begin, end) added or changed since the last ClearDirty, empty if begin == end
+    void DirtyRange(unsigned int &begin, unsigned int &end) const { begin = this->dirtyBegin; end = this->dirtyEnd; }
+    void ClearDirty() { this->dirtyBegin = this->dirtyEnd = 0; }
+
+    glm::vec2 Position(unsigned int i) const { return glm::vec2(this->X[i], this->Y[i]); }
+    glm::vec2 Extent(unsigned int i) const   { return glm::vec2(this->W[i], this->H[i]); }
+
+    // circle-vs-AABB test of bricks [first, first + kBrickLanes), first must be
+    // a multiple of kBrickLanes. Returns one bit per live brick the circle overlaps.
+    unsigned int OverlapMask(glm::vec2 center, float radius, unsigned int first) const;
+
+private:
+    unsigned int count;
+    unsigned int destructible, remaining;
+    unsigned int dirtyBegin, dirtyEnd;
+
+    void markDirty(unsigned int begin, unsigned int end);
+};
+
+
+// index of the lowest set bit, bits must not be zero
+inline unsigned int LowestBit(uint64_t bits) {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, bits);
+    return (unsigned int)index;
+#else
+    return (unsigned int)__builtin_ctzll(bits);
+#endif
+}
+
+#endif
@@ -4,18 +4,16 @@
 #include "resource_manager.h"
 #include "sprite_renderer.h"
 #include "particle.h"
+#include "gpu_particles.h"
 #include "post_process.h"
 
+#include <algorithm>
+#include <iterator>
+
 // #define CHAOS_DEBBUG
 // #define CONFUSE_DEBUG
 
 
-BallObject          *Ball;
-GameObject          *Player;
-SpriteRenderer      *Renderer;
-ParticleGenerator   *Particles;
-PostProcessor       *Effects;
-
 const float PLAYER_VELOCITY(500.0f);
 const glm::vec2 PLAYER_SIZE(100.0f, 20.0f);
 
@@ -23,26 +21,57 @@ const float BALL_RADIUS = 20.0f;
 const unsigned int kParticleAmount = 800;
 const glm::vec2 INITIAL_BALL_VELOCITY(100.0f, -350.0f);
 
-float strength = 2.0f;
-float ShakeTime = 0.0f;
+// random streams derived from the game seed
+const uint64_t kGameplayStream = 1;
+const uint64_t kCosmeticStream = 2;
+
+Game::Game(unsigned int width, unsigned int height, uint64_t seed) 
+    : State(GAME_ACTIVE), Keys(), Width(width), Height(height), Level(0), ActivePowerUps(), Headless(false), GPUParticles(false), ReferenceCollisions(false),
+      Confuse(false), Chaos(false), Shake(false), ShakeTime(0.0f), Strength(2.0f),
+      Seed(seed), GameplayRng(seed, kGameplayStream), Score(0), BallsLost(0), Ticks(0), trailEmitter(kNoEmitter) {}
+
+
+Game::~Game() {}
+
+
+// defined here where the renderer types are complete
+Game::Game(Game &&other) = default;
 
-void ActivatePowerUp(PowerUp &powerUp);
 
+void Game::Init(bool headless) {
+    this->Headless = headless;
+    if (!headless)
+        this->initRenderData();
 
-Game::Game(unsigned int width, unsigned int height) 
-    : State(GAME_ACTIVE), Keys(), Width(width), Height(height) {}
+#ifdef CHAOS_DEBBUG
+    this->Chaos = true;
+#endif
+#ifdef CONFUSE_DEBUG
+    this->Confuse = true;
+#endif
+
+    // load levels
+    GameLevel one;      one.Load("levels/one.lvl", this->Width, this->Height / 2);
+    GameLevel two;      two.Load("levels/two.lvl", this->Width, this->Height / 2);
+    GameLevel three;    three.Load("levels/three.lvl", this->Width, this->Height / 2);
+    GameLevel four;     four.Load("levels/four.lvl", this->Width, this->Height / 2);
+    this->Levels.push_back(std::move(one));
+    this->Levels.push_back(std::move(two));
+    this->Levels.push_back(std::move(three));
+    this->Levels.push_back(std::move(four));
+    this->Level = 0;
 
+    // configure game objects
+    glm::vec2 playerPos = glm::vec2(this->Width / 2 - PLAYER_SIZE.x / 2, this->Height - PLAYER_SIZE.y);
+    this->Player = GameObject(playerPos, PLAYER_SIZE, ResourceManager::GetTexture("paddle"));
 
-Game::~Game() {
-    delete Renderer;
-    delete Player;
-    delete Ball;
-    delete Particles;
-    delete Effects;
+    glm::vec2 ballPos = playerPos + glm::vec2(PLAYER_SIZE.x / 2.0f - BALL_RADIUS, -BALL_RADIUS * 2.0f);
+    this->Ball = BallObject(ballPos, BALL_RADIUS, INITIAL_BALL_VELOCITY, ResourceManager::GetTexture("face"));
 }
 
 
-void Game::Init() {
+// shaders, textures and renderers, skipped in headless mode where no GL context exists
+void Game::initRenderData() {
     // load shaders
     ResourceManager::LoadShader("shaders/sprite.vs", "shaders/sprite.frag", nullptr, "sprite");
     ResourceManager::LoadShader("shaders/particle.vs", "shaders/particle.frag", nullptr, "particle");
@@ -59,64 +88,77 @@ void Game::Init() {
     ResourceManager::GetShader("particle").SetMatrix4("projection", projection);
 
     // load textures
-    ResourceManager::LoadTexture("textures/awesomeface.png", true, "face");
+    // the background fills the screen and particles use their own shader, so they keep their own textures
     ResourceManager::LoadTexture("textures/background.jpg", false, "background");
-    ResourceManager::LoadTexture("textures/block.png", false, "block");
-    ResourceManager::LoadTexture("textures/block_solid.png", false, "block_solid");
-    ResourceManager::LoadTexture("textures/paddle.png", true, "paddle");
     ResourceManager::LoadTexture("textures/particle.png", true, "particle");
-    ResourceManager::LoadTexture("textures/powerup_speed.png", true, "powerup_speed");
-    ResourceManager::LoadTexture("textures/powerup_sticky.png", true, "powerup_sticky");
-    ResourceManager::LoadTexture("textures/powerup_increase.png", true, "powerup_increase");
-    ResourceManager::LoadTexture("textures/powerup_confuse.png", true, "powerup_confuse");
-    ResourceManager::LoadTexture("textures/powerup_chaos.png", true, "powerup_chaos");
-    ResourceManager::LoadTexture("textures/powerup_passthrough.png", true, "powerup_passthrough");
+    // everything else shares one atlas so the sprite renderer can batch it
+    ResourceManager::LoadAtlas({
+        { "textures/awesomeface.png",         "face" },
+        { "textures/block.png",               "block" },
+        { "textures/block_solid.png",         "block_solid" },
+        { "textures/paddle.png",              "paddle" },
+        { "textures/powerup_speed.png",       "powerup_speed" },
+        { "textures/powerup_sticky.png",      "powerup_sticky" },
+        { "textures/powerup_increase.png",    "powerup_increase" },
+        { "textures/powerup_confuse.png",     "powerup_confuse" },
+        { "textures/powerup_chaos.png",       "powerup_chaos" },
+        { "textures/powerup_passthrough.png", "powerup_passthrough" },
+    }, "textures/sprites.atlas");
+    for (unsigned int type = 0; type < POWERUP_TYPE_COUNT; ++type)
+        this->powerUpTextures[type] = ResourceManager::GetTexture(PowerUpKinds[type].Texture);
 
     // set render-specific controls
-    Renderer = new SpriteRenderer(ResourceManager::GetShader("sprite"));
-    Particles = new ParticleGenerator(ResourceManager::GetShader("particle"), ResourceManager::GetTexture("particle"), kParticleAmount);
-    Effects = new PostProcessor(ResourceManager::GetShader("postprocessing"), this->Width, this->Height);
-
-#ifdef CHAOS_DEBBUG
-    Effects->chaos = true;
-#endif
-#ifdef CONFUSE_DEBUG
-    Effects->confuse = true;
-#endif
+    this->Renderer.reset(new SpriteRenderer(ResourceManager::GetShader("sprite")));
+    if (this->GPUParticles) {
+        ResourceManager::LoadFeedbackShader("shaders/particle_update.vs", { "outPosition", "outVelocity", "outColor", "outLife" }, "particle_update");
+        this->Particles.reset(new GPUParticleGenerator(ResourceManager::GetShader("particle"), ResourceManager::GetShader("particle_update"),
+                                                       ResourceManager::GetTexture("particle"), kParticleAmount, Random(this->Seed, kCosmeticStream)));
+    }
+    else
+        this->Particles.reset(new ParticleGenerator(ResourceManager::GetShader("particle"), ResourceManager::GetTexture("particle"), kParticleAmount,
+                                                    Random(this->Seed, kCosmeticStream)));
+    // the ball trail follows Ball for the life of the game, the other effects are bursts
+    ParticleEmitter trail(EMITTER_ATTACHED);
+    trail.Position = glm::vec2(this->Ball.Radius / 2.0f);
+    trail.Inherit = -0.1f;
+    trail.Spread = 5.0f;
+    trail.Life = 0.8f;
+    trail.Rate = 240.0f;
+    trail.Budget = 200;
+    this->trailEmitter = this->Particles->AddEmitter(trail);
+    this->Effects.reset(new PostProcessor(ResourceManager::GetShader("postprocessing"), this->Width, this->Height));
+}
 
-    // load levels
-    GameLevel one;      one.Load("levels/one.lvl", this->Width, this->Height / 2);
-    GameLevel two;      two.Load("levels/two.lvl", this->Width, this->Height / 2);
-    GameLevel three;    three.Load("levels/three.lvl", this->Width, this->Height / 2);
-    GameLevel four;     four.Load("levels/four.lvl", this->Width, this->Height / 2);
-    this->Levels.push_back(one);
-    this->Levels.push_back(two);
-    this->Levels.push_back(three);
-    this->Levels.push_back(four);
-    this->Level = 0;
 
-    // configure game objects
-    glm::vec2 playerPos = glm::vec2(this->Width / 2 - PLAYER_SIZE.x / 2, this->Height - PLAYER_SIZE.y);
-    Player = new GameObject(playerPos, PLAYER_SIZE, ResourceManager::GetTexture("paddle"));
+void Game::Step(float dt) {
+    // remember where everything was so Render can interpolate into this tick
+    this->Ball.PrevPosition = this->Ball.Position;
+    this->Player.PrevPosition = this->Player.Position;
+    this->PowerUps.ForEach([](unsigned int, PowerUp &powerUp) { powerUp.PrevPosition = powerUp.Position; });
 
-    glm::vec2 ballPos = playerPos + glm::vec2(PLAYER_SIZE.x / 2.0f - BALL_RADIUS, -BALL_RADIUS * 2.0f);
-    Ball = new BallObject(ballPos, BALL_RADIUS, INITIAL_BALL_VELOCITY, ResourceManager::GetTexture("face"));
+    this->ProcessInput(dt);
+    this->Update(dt);
+    ++this->Ticks;
 }
 
 
 void Game::Update(float dt) {
-    Ball->Move(dt, this->Width);
+    this->Ball.Move(dt, this->Width);
     this->DoCollisions();
-    Particles->Update(dt, *Ball, 2, glm::vec2(Ball->Radius / 2.0f));
+    if (this->Particles) {
+        this->Particles->MoveEmitter(this->trailEmitter, this->Ball.Position, this->Ball.Velocity);
+        this->Particles->Update(dt);
+    }
     this->UpdatePowerUps(dt);
 
-    if (ShakeTime > 0.0f) {
-        ShakeTime -= dt;
-        if (ShakeTime <= 0.0f)
-            Effects->shake = false;
+    if (this->ShakeTime > 0.0f) {
+        this->ShakeTime -= dt;
+        if (this->ShakeTime <= 0.0f)
+            this->Shake = false;
     }
 
-    if (Ball->Position.y >= this->Height) {
+    if (this->Ball.Position.y >= this->Height) {
+        ++this->BallsLost;
         this->ResetLevel();
         this->ResetPlayer();
     }
@@ -128,46 +170,108 @@ void Game::ProcessInput(float dt) {
         float velocity = PLAYER_VELOCITY * dt;
 
         if (this->Keys[GLFW_KEY_A] || this->Keys[GLFW_KEY_LEFT]) {
-            if (Player->Position.x >= 0.0f) {
-                Player->Position.x -= velocity;
-                if (Ball->Stuck)
-                    Ball->Position.x -= velocity;
+            if (this->Player.Position.x >= 0.0f) {
+                this->Player.Position.x -= velocity;
+                if (this->Ball.Stuck)
+                    this->Ball.Position.x -= velocity;
             }
         }
         if (this->Keys[GLFW_KEY_D] || this->Keys[GLFW_KEY_RIGHT]) {
-            if (Player->Position.x <= this->Width - Player->Size.x) {
-                Player->Position.x += velocity;
-                if (Ball->Stuck)
-                    Ball->Position.x += velocity;
+            if (this->Player.Position.x <= this->Width - this->Player.Size.x) {
+                this->Player.Position.x += velocity;
+                if (this->Ball.Stuck)
+                    this->Ball.Position.x += velocity;
             }
         }
         if (this->Keys[GLFW_KEY_SPACE])
-            Ball->Stuck = false;
+            this->Ball.Stuck = false;
    }
 }
 
 
-void Game::Render() {
+void Game::Render(float alpha) {
+    if (this->Headless)
+        return;
+
     if (this->State == GAME_ACTIVE) {
-        Effects->BeginRender();
+        this->Effects->confuse = this->Confuse;
+        this->Effects->chaos = this->Chaos;
+        this->Effects->shake = this->Shake;
+        this->Effects->BeginRender();
 
-        Renderer->DrawSprite(ResourceManager::GetTexture("background"), 
+        this->Renderer->DrawSprite(ResourceManager::GetTexture("background"), 
             glm::vec2(0, 0), glm::vec2(this->Width, this->Height), 0.0f
         );
-        this->Levels[this->Level].Draw(*Renderer);
-        Player->Draw(*Renderer);
-        Particles->Draw();
-        Ball->Draw(*Renderer);
-
-        for (PowerUp &powerUp : this->PowerUps)
+        this->Levels[this->Level].Draw(*this->Renderer);
+        this->Player.Draw(*this->Renderer, alpha);
+        // particles draw themselves, everything queued so far goes first
+        this->Renderer->Flush();
+        this->Particles->Draw();
+        this->Ball.Draw(*this->Renderer, alpha);
+
+        this->PowerUps.ForEach([this, alpha](unsigned int, const PowerUp &powerUp) {
             if (!powerUp.Destroyed)
-                powerUp.Draw(*Renderer);
+                this->Renderer->DrawSprite(this->powerUpTextures[powerUp.Type], glm::mix(powerUp.PrevPosition, powerUp.Position, alpha),
+                                           POWERUP_SIZE, 0.0f, PowerUpKinds[powerUp.Type].Color);
+        });
+
+        this->Renderer->EndFrame();
+        this->Effects->EndRender();
+        this->Effects->Render((float)glfwGetTime());
+    }
+}
+
 
-        Effects->EndRender();
-        Effects->Render((float)glfwGetTime());
+// FNV-1a over the raw bytes of each field
+static void hashBytes(uint32_t &hash, const void *data, size_t size) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 16777619u;
     }
 }
 
+template <typename T>
+static void hashValue(uint32_t &hash, const T &value) {
+    hashBytes(hash, &value, sizeof(T));
+}
+
+uint32_t Game::Checksum() const {
+    uint32_t hash = 2166136261u;
+    hashValue(hash, this->Ticks);
+    hashValue(hash, this->Level);
+    hashValue(hash, this->Score);
+    hashValue(hash, this->BallsLost);
+    hashValue(hash, this->GameplayRng.State());
+
+    hashValue(hash, this->Ball.Position);
+    hashValue(hash, this->Ball.Velocity);
+    hashValue(hash, this->Ball.Stuck);
+    hashValue(hash, this->Ball.Sticky);
+    hashValue(hash, this->Ball.PassThrough);
+    hashValue(hash, this->Player.Position);
+    hashValue(hash, this->Player.Size);
+
+    hashValue(hash, this->Confuse);
+    hashValue(hash, this->Chaos);
+    hashValue(hash, this->Shake);
+    hashValue(hash, this->ShakeTime);
+    hashValue(hash, this->ActivePowerUps);
+
+    const std::vector<uint64_t> &destroyed = this->Levels[this->Level].Bricks.Destroyed;
+    hashBytes(hash, destroyed.data(), destroyed.size() * sizeof(uint64_t));
+
+    this->PowerUps.ForEach([&hash](unsigned int i, const PowerUp &powerUp) {
+        hashValue(hash, i);
+        hashValue(hash, powerUp.Type);
+        hashValue(hash, powerUp.Position);
+        hashValue(hash, powerUp.Duration);
+        hashValue(hash, powerUp.Activated);
+        hashValue(hash, powerUp.Destroyed);
+    });
+    return hash;
+}
+
 
 // bool CheckCollision(BallObject &a, GameObject &b) {
 //     glm::vec2 center(a.Position + a.Radius);
@@ -203,19 +307,23 @@ Direction VectorDirection(glm::vec2 target) {
     return (Direction)best_match;
 }
 
-bool CheckCollision(GameObject &a, GameObject &b) {
-    bool collisionX = a.Position.x + a.Size.x >= b.Position.x && b.Position.x + b.Size.x >= a.Position.x;
-    bool collisionY = a.Position.y + a.Size.y >= b.Position.y && b.Position.y + b.Size.y >= a.Position.y;
+bool CheckCollision(glm::vec2 position, glm::vec2 size, GameObject &b) {
+    bool collisionX = position.x + size.x >= b.Position.x && b.Position.x + b.Size.x >= position.x;
+    bool collisionY = position.y + size.y >= b.Position.y && b.Position.y + b.Size.y >= position.y;
     return collisionX && collisionY;
 }
 
-Collision CheckCollision(BallObject &a, GameObject &b) {
+bool CheckCollision(GameObject &a, GameObject &b) {
+    return CheckCollision(a.Position, a.Size, b);
+}
+
+Collision CheckCollision(BallObject &a, glm::vec2 position, glm::vec2 size) {
     glm::vec2 center(a.Position + a.Radius);
 
-    glm::vec2 aabb_half_extents(b.Size.x / 2, b.Size.y / 2);
+    glm::vec2 aabb_half_extents(size.x / 2, size.y / 2);
     glm::vec2 aabb_center(
-        b.Position.x + aabb_half_extents.x,
-        b.Position.y + aabb_half_extents.y
+        position.x + aabb_half_extents.x,
+        position.y + aabb_half_extents.y
     );
 
     glm::vec2 diff = center - aabb_center;
@@ -229,199 +337,278 @@ Collision CheckCollision(BallObject &a, GameObject &b) {
     }
 }
 
+Collision CheckCollision(BallObject &a, GameObject &b) {
+    return CheckCollision(a, b.Position, b.Size);
+}
+
 
 void Game::DoCollisions() {
-    // Ball-Brisks collision
-    for (auto &obj : this->Levels[this->Level].Bricks) {
-        if (!obj.Destroyed) {
-            Collision res = CheckCollision(*Ball, obj);
-            if (std::get<0>(res)) {
-                if (!obj.IsSolid) {
-                    obj.Destroyed = true;
-                    this->SpawnPowerUps(obj);
-                }
-                else {
-                    // if block is solid, enable shake effect
-                    ShakeTime = 0.05f;
-                    Effects->shake = true;
-                }
-
-                Direction dir = std::get<1>(res);
-                glm::vec2 diff = std::get<2>(res);
-
-                if (!(Ball->PassThrough && !obj.IsSolid)) {
-                    if (dir == LEFT || dir == RIGHT) {
-                        Ball->Velocity.x = -Ball->Velocity.x;
-                        float penetration = Ball->Radius - std::abs(diff.x);
-                        if (dir == LEFT)
-                            Ball->Position.x += penetration;
-                        else
-                            Ball->Position.x -= penetration;
-                    }
-                    else {
-                        Ball->Velocity.y = -Ball->Velocity.y;
-                        float penetration = Ball->Radius - std::abs(diff.y);
-                        if (dir == UP)
-                            Ball->Position.y -= penetration;
-                        else
-                            Ball->Position.y += penetration;
-                    }
-                }
-            }
-        }
-    }
+    if (this->ReferenceCollisions)
+        this->collideBricksReference();
+    else
+        this->collideBricks();
 
     // Ball-Player collision
-    Collision res = CheckCollision(*Ball, *Player);
-    if (!Ball->Stuck && std::get<0>(res)) {
-        float center = Player->Position.x + Player->Size.x / 2;
-        float distance = (Ball->Position.x + Ball->Radius) - center;
-        float percentage = distance / (Player->Size.x / 2);
-
-        glm::vec2 oldV = Ball->Velocity;
-        Ball->Velocity.x = INITIAL_BALL_VELOCITY.x * percentage * strength;
-        Ball->Velocity = glm::normalize(Ball->Velocity) * glm::length(oldV);
-        Ball->Velocity.y = -1.0f * std::abs(Ball->Velocity.y);
-
-        Ball->Stuck = Ball->Sticky;
+    Collision res = CheckCollision(this->Ball, this->Player);
+    if (!this->Ball.Stuck && std::get<0>(res)) {
+        float center = this->Player.Position.x + this->Player.Size.x / 2;
+        float distance = (this->Ball.Position.x + this->Ball.Radius) - center;
+        float percentage = distance / (this->Player.Size.x / 2);
+
+        glm::vec2 oldV = this->Ball.Velocity;
+        this->Ball.Velocity.x = INITIAL_BALL_VELOCITY.x * percentage * this->Strength;
+        this->Ball.Velocity = glm::normalize(this->Ball.Velocity) * glm::length(oldV);
+        this->Ball.Velocity.y = -1.0f * std::abs(this->Ball.Velocity.y);
+
+        this->Ball.Stuck = this->Ball.Sticky;
+        this->burst(glm::vec2(this->Ball.Position.x + this->Ball.Radius, this->Player.Position.y), glm::vec3(1.0f), 10, 80.0f, 0.4f);
     }
 
-    for (auto &powerUp : this->PowerUps) {
+    this->PowerUps.ForEach([this](unsigned int, PowerUp &powerUp) {
         if (!powerUp.Destroyed) {
             if (powerUp.Position.y >= this->Height) {
                 powerUp.Destroyed = true;
-                continue;
+                return;
             }
             
-            if (CheckCollision(powerUp, *Player)) {
+            if (CheckCollision(powerUp.Position, POWERUP_SIZE, this->Player)) {
                 ActivatePowerUp(powerUp);
+                this->burst(powerUp.Position + POWERUP_SIZE / 2.0f, PowerUpKinds[powerUp.Type].Color, 24, 150.0f, 0.6f);
                 powerUp.Destroyed = true;
                 powerUp.Activated = true;
             }
         }
+    });
+}
+
+
+void Game::collideBricks() {
+    // Ball-Brisks collision, only the grid cells around the ball are tested.
+    // The range is padded by the radius since resolving a hit pushes the ball
+    // by up to one radius before the next brick is tested.
+    GameLevel &level = this->Levels[this->Level];
+    BrickStore &bricks = level.Bricks;
+    unsigned int x0, y0, x1, y1;
+    bool inGrid = level.CellRange(this->Ball.Position - this->Ball.Radius,
+                                  this->Ball.Position + this->Ball.Size + this->Ball.Radius,
+                                  x0, y0, x1, y1);
+    for (unsigned int y = y0; inGrid && y <= y1; ++y) {
+        // bricks are stored row by row, so the cells of one row map to a
+        // contiguous index range that the kernel tests 8 bricks at a time
+        const int *row = &level.Grid[y * level.GridWidth];
+        int first = -1, last = -1;
+        for (unsigned int x = x0; x <= x1; ++x) {
+            if (row[x] < 0)
+                continue;
+            if (first < 0)
+                first = row[x];
+            last = row[x];
+        }
+        if (first < 0)
+            continue;
+
+        for (unsigned int group = first - first % kBrickLanes; group <= (unsigned int)last; group += kBrickLanes) {
+            unsigned int mask = bricks.OverlapMask(this->Ball.Position + this->Ball.Radius, this->Ball.Radius, group);
+
+            for (unsigned int lane = 0; mask != 0 && lane < kBrickLanes; ++lane) {
+                unsigned int i = group + lane;
+                if (!(mask & (1u << lane)) || i < (unsigned int)first || i > (unsigned int)last)
+                    continue;
+
+                // earlier hits may have pushed the ball, so resolve against its current position
+                Collision res = CheckCollision(this->Ball, bricks.Position(i), bricks.Extent(i));
+                if (!std::get<0>(res) || !this->resolveBrickHit(i, res))
+                    continue;
+                // the ball moved, so lanes after this one may overlap now where they did not
+                // before (or the other way round); test them again at its new position
+                mask = bricks.OverlapMask(this->Ball.Position + this->Ball.Radius, this->Ball.Radius, group) & ~((2u << lane) - 1u);
+            }
+        }
+    }
+}
+
+
+// every live brick in index order with the scalar test, no grid, no kernel
+void Game::collideBricksReference() {
+    BrickStore &bricks = this->Levels[this->Level].Bricks;
+    for (unsigned int i = 0; i < bricks.Count(); ++i) {
+        if (bricks.IsDestroyed(i))
+            continue;
+        Collision res = CheckCollision(this->Ball, bricks.Position(i), bricks.Extent(i));
+        if (std::get<0>(res))
+            this->resolveBrickHit(i, res);
+    }
+}
+
+
+// scores, shakes and bounces off brick i the way a hit has always been handled
+bool Game::resolveBrickHit(unsigned int i, const Collision &res) {
+    BrickStore &bricks = this->Levels[this->Level].Bricks;
+    bool solid = bricks.IsSolid(i);
+    if (!solid) {
+        bricks.Destroy(i);
+        ++this->Score;
+        this->burst(bricks.Position(i) + bricks.Extent(i) / 2.0f, bricks.Colors[i], 16, 120.0f, 0.5f);
+        this->SpawnPowerUps(bricks.Position(i));
+    }
+    else {
+        // if block is solid, enable shake effect
+        this->ShakeTime = 0.05f;
+        this->Shake = true;
+    }
+
+    Direction dir = std::get<1>(res);
+    glm::vec2 diff = std::get<2>(res);
+
+    if (this->Ball.PassThrough && !solid)
+        return false;
+    if (dir == LEFT || dir == RIGHT) {
+        this->Ball.Velocity.x = -this->Ball.Velocity.x;
+        float penetration = this->Ball.Radius - std::abs(diff.x);
+        if (dir == LEFT)
+            this->Ball.Position.x += penetration;
+        else
+            this->Ball.Position.x -= penetration;
+    }
+    else {
+        this->Ball.Velocity.y = -this->Ball.Velocity.y;
+        float penetration = this->Ball.Radius - std::abs(diff.y);
+        if (dir == UP)
+            this->Ball.Position.y -= penetration;
+        else
+            this->Ball.Position.y += penetration;
     }
+    return true;
+}
+
+
+// a one-off spray of particles, for feedback on gameplay events
+void Game::burst(glm::vec2 center, glm::vec3 color, unsigned int count, float speed, float life) {
+    if (!this->Particles)
+        return;
+    ParticleEmitter burst(EMITTER_BURST);
+    burst.Position = center;
+    burst.Spread = 4.0f;
+    burst.Speed = speed;
+    burst.Color = color;
+    burst.Life = life;
+    burst.Count = burst.Budget = count;
+    this->Particles->AddEmitter(burst);
 }
 
 
 void Game::ResetLevel() {
-    if (this->Level == 0)
-        this->Levels[0].Load("levels/one.lvl", this->Width, this->Height / 2);
-    else if (this->Level == 1)
-        this->Levels[1].Load("levels/two.lvl", this->Width, this->Height / 2);
-    else if (this->Level == 2)
-        this->Levels[2].Load("levels/three.lvl", this->Width, this->Height / 2);
-    else if (this->Level == 3)
-        this->Levels[3].Load("levels/four.lvl", this->Width, this->Height / 2);
+    // the layout never changes after Init, so bring the bricks back instead of reloading the file
+    this->Levels[this->Level].Reset();
 }
 
 void Game::ResetPlayer() {
-    Player->Size = PLAYER_SIZE;
-    Player->Position = glm::vec2(this->Width / 2.0f - PLAYER_SIZE.x / 2.0f, this->Height - PLAYER_SIZE.y);
-    Ball->Reset(Player->Position + glm::vec2(PLAYER_SIZE.x / 2.0f - BALL_RADIUS, -(BALL_RADIUS * 2.0f)), INITIAL_BALL_VELOCITY);
-    Effects->chaos = Effects->confuse = false;
-    Ball->PassThrough = Ball->Sticky = false;
-    Player->Color = glm::vec3(1.0f);
-    Ball->Color = glm::vec3(1.0f);
-
-    this->PowerUps.clear();
+    this->Player.Size = PLAYER_SIZE;
+    this->Player.Position = glm::vec2(this->Width / 2.0f - PLAYER_SIZE.x / 2.0f, this->Height - PLAYER_SIZE.y);
+    this->Player.PrevPosition = this->Player.Position;
+    this->Ball.Reset(this->Player.Position + glm::vec2(PLAYER_SIZE.x / 2.0f - BALL_RADIUS, -(BALL_RADIUS * 2.0f)), INITIAL_BALL_VELOCITY);
+    this->Chaos = this->Confuse = false;
+    this->Ball.PassThrough = this->Ball.Sticky = false;
+    this->Player.Color = glm::vec3(1.0f);
+    this->Ball.Color = glm::vec3(1.0f);
+
+    this->PowerUps.Clear();
+    std::fill(std::begin(this->ActivePowerUps), std::end(this->ActivePowerUps), 0u);
 }
 
 
-bool ShouldSpawn(unsigned int chance) {
-    unsigned int random = rand() % chance;
+bool ShouldSpawn(Random &rng, unsigned int chance) {
+    unsigned int random = rng.Below(chance);
     return random == 0;
 }
 
-void Game::SpawnPowerUps(GameObject &block) {
-    if (ShouldSpawn(55))
-        this->PowerUps.push_back(PowerUp("speed", glm::vec3(0.5f, 0.5f, 1.0f), 0.0f, block.Position, ResourceManager::GetTexture("powerup_speed")));
-    if (ShouldSpawn(55))
-        this->PowerUps.push_back(PowerUp("sticky", glm::vec3(1.0f, 0.5f, 1.0f), 20.0f, block.Position, ResourceManager::GetTexture("powerup_sticky")));
-    if (ShouldSpawn(55))
-        this->PowerUps.push_back(PowerUp("pass-through", glm::vec3(0.5f, 1.0f, 0.5f), 10.0f, block.Position, ResourceManager::GetTexture("powerup_passthrough")));
-    if (ShouldSpawn(55))
-        this->PowerUps.push_back(PowerUp("pad-size-increase", glm::vec3(1.0f, 0.6f, 0.4), 0.0f, block.Position, ResourceManager::GetTexture("powerup_increase")));
-    if (ShouldSpawn(15))
-        this->PowerUps.push_back(PowerUp("confuse", glm::vec3(1.0f, 0.3f, 0.3f), 15.0f, block.Position, ResourceManager::GetTexture("powerup_confuse")));
-    if (ShouldSpawn(15))
-        this->PowerUps.push_back(PowerUp("chaos", glm::vec3(0.9f, 0.25f, 0.25f), 15.0f, block.Position, ResourceManager::GetTexture("powerup_chaos")));
-}
-
-void ActivatePowerUp(PowerUp &powerUp) {
-    if (powerUp.Type == "speed") {
-        Ball->Velocity *= 1.2;
-    }
-    else if (powerUp.Type == "sticky") {
-        Ball->Sticky = true;
-        Player->Color = glm::vec3(1.0f, 0.5f, 1.0f);
-    }
-    else if (powerUp.Type == "pass-through") {
-        Ball->PassThrough = true;
-        Ball->Color = glm::vec3(1.0f, 0.5f, 0.5f);
-    }
-    else if (powerUp.Type == "pad-size-increase") {
-        Player->Size.x += 50;
-    }
-    else if (powerUp.Type == "confuse") {
-        if (!Effects->chaos)
-            Effects->confuse = true;
-    }
-    else if (powerUp.Type == "chaos") {
-        if (!Effects->confuse)
-            Effects->chaos = true;
-    }
+static void activateSpeed(Game &game) {
+    game.Ball.Velocity *= 1.2;
+}
+
+static void activateSticky(Game &game) {
+    game.Ball.Sticky = true;
+    game.Player.Color = glm::vec3(1.0f, 0.5f, 1.0f);
+}
+
+static void deactivateSticky(Game &game) {
+    game.Ball.Sticky = false;
+    game.Player.Color = glm::vec3(1.0f);
+}
+
+static void activatePassThrough(Game &game) {
+    game.Ball.PassThrough = true;
+    game.Ball.Color = glm::vec3(1.0f, 0.5f, 0.5f);
+}
+
+static void deactivatePassThrough(Game &game) {
+    game.Ball.PassThrough = false;
+    game.Ball.Color = glm::vec3(1.0f);
+}
+
+static void activatePadSizeIncrease(Game &game) {
+    game.Player.Size.x += 50;
+}
+
+static void activateConfuse(Game &game) {
+    if (!game.Chaos)
+        game.Confuse = true;
+}
+
+static void deactivateConfuse(Game &game) {
+    game.Confuse = false;
+}
+
+static void activateChaos(Game &game) {
+    if (!game.Confuse)
+        game.Chaos = true;
 }
 
-bool IsOtherPowerUpActive(std::vector<PowerUp> &powerUps, std::string type) {
-    for (const PowerUp &powerUp : powerUps) {
-        if (powerUp.Activated)
-            if (powerUp.Type == type)
-                return true;
+static void deactivateChaos(Game &game) {
+    game.Chaos = false;
+}
+
+// spawn rolls happen in table order, keep it stable so seeded runs reproduce
+const PowerUpKind PowerUpKinds[POWERUP_TYPE_COUNT] = {
+    { "powerup_speed",       glm::vec3(0.5f, 0.5f, 1.0f),   0.0f, 55, activateSpeed,           nullptr },
+    { "powerup_sticky",      glm::vec3(1.0f, 0.5f, 1.0f),  20.0f, 55, activateSticky,          deactivateSticky },
+    { "powerup_passthrough", glm::vec3(0.5f, 1.0f, 0.5f),  10.0f, 55, activatePassThrough,     deactivatePassThrough },
+    { "powerup_increase",    glm::vec3(1.0f, 0.6f, 0.4f),   0.0f, 55, activatePadSizeIncrease, nullptr },
+    { "powerup_confuse",     glm::vec3(1.0f, 0.3f, 0.3f),  15.0f, 15, activateConfuse,         deactivateConfuse },
+    { "powerup_chaos",       glm::vec3(0.9f, 0.25f, 0.25f), 15.0f, 15, activateChaos,           deactivateChaos },
+};
+
+
+void Game::SpawnPowerUps(glm::vec2 position) {
+    for (unsigned int type = 0; type < POWERUP_TYPE_COUNT; ++type) {
+        const PowerUpKind &kind = PowerUpKinds[type];
+        if (ShouldSpawn(this->GameplayRng, kind.Chance))
+            this->PowerUps.Spawn((PowerUpType)type, position);
     }
-    return false;
-}  
+}
+
+void Game::ActivatePowerUp(PowerUp &powerUp) {
+    ++this->ActivePowerUps[powerUp.Type];
+    PowerUpKinds[powerUp.Type].Activate(*this);
+}
 
 void Game::UpdatePowerUps(float dt) {
-    for (PowerUp &powerUp : this->PowerUps) {
-        powerUp.Position += powerUp.Velocity * dt;
+    this->PowerUps.ForEach([this, dt](unsigned int i, PowerUp &powerUp) {
+        powerUp.Position += VELOCITY * dt;
         if (powerUp.Activated) {
             powerUp.Duration -= dt;
 
             if (powerUp.Duration <= 0.0f) {
-                // remove powerup from list (will later be removed)
                 powerUp.Activated = false;
 
-                // deactivate effects
-                if (powerUp.Type == "sticky") {
-                    if (!IsOtherPowerUpActive(this->PowerUps, "sticky")) {
-                        Ball->Sticky = false;
-                        Player->Color = glm::vec3(1.0f);
-                    }
-                }
-                else if (powerUp.Type == "pass-through") {
-                    if (!IsOtherPowerUpActive(this->PowerUps, "pass-through")) {
-                        Ball->PassThrough = false;
-                        Ball->Color = glm::vec3(1.0f);
-                    }
-                }
-                else if (powerUp.Type == "confuse") {
-                    if (!IsOtherPowerUpActive(this->PowerUps, "confuse"))
-                        Effects->confuse = false;
-                }
-                else if (powerUp.Type == "chaos") {
-                    if (!IsOtherPowerUpActive(this->PowerUps, "chaos"))
-                        Effects->chaos = false;
-                }
+                // deactivate the effect once no other power-up of this kind is still running
+                if (--this->ActivePowerUps[powerUp.Type] == 0 && PowerUpKinds[powerUp.Type].Deactivate)
+                    PowerUpKinds[powerUp.Type].Deactivate(*this);
             }
         }
-    }
 
-    this->PowerUps.erase(
-        std::remove_if(
-            this->PowerUps.begin(),
-            this->PowerUps.end(),
-            [](const PowerUp &powerUp) { return powerUp.Destroyed && !powerUp.Activated; }
-        ),
-        this->PowerUps.end()
-    );
+        // caught power-ups stay in the pool until their effect runs out
+        if (powerUp.Destroyed && !powerUp.Activated)
+            this->PowerUps.Release(i);
+    });
 }
@@ -1,12 +1,20 @@
 #ifndef GAME_H
 #define GAME_H
 
+#include <memory>
 #include <tuple>
 #include <vector>
 #include <GLFW/glfw3.h>
 
+#include "ball.h"
 #include "level.h"
+#include "object.h"
 #include "power_up.h"
+#include "random.h"
+#include "sprite_renderer.h"
+
+class ParticleSystem;
+class PostProcessor;
 
 
 enum GameState {
@@ -24,26 +32,68 @@ enum Direction {
 
 using Collision = std::tuple<bool, Direction, glm::vec2>;
 
+const unsigned int KEY_COUNT = 1024;    // size of Game::Keys, key codes at or above it are ignored
+
 
 class Game {
 public:
     GameState               State;	
 
-    bool                    Keys[1024];
+    bool                    Keys[KEY_COUNT];
     unsigned int            Width, Height;
     std::vector<GameLevel>  Levels;
     unsigned int            Level;
-    std::vector<PowerUp>    PowerUps;
+    PowerUpPool             PowerUps;
+    unsigned int            ActivePowerUps[POWERUP_TYPE_COUNT];    // activated and not yet expired, per kind
+
+    // headless games never touch GL: no shaders, textures or renderers
+    bool                    Headless;
+    // simulate particles on the GPU with transform feedback instead of on the CPU; read by Init
+    bool                    GPUParticles;
+    // test every brick in order with the scalar check, as before the grid and
+    // SIMD kernel; only for checking that the fast path plays the same game
+    bool                    ReferenceCollisions;
+    // post-processing effects toggled by gameplay, handed to the post processor when rendering
+    bool                    Confuse, Chaos, Shake;
+    float                   ShakeTime;
+
+    // all simulation and render state is owned by the instance, so any number
+    // of games can run side by side in one process
+    BallObject              Ball;
+    GameObject              Player;
+    float                   Strength;   // how much the paddle hit position bends the ball
+
+    // simulation results depend only on Seed and the inputs: gameplay draws
+    // from GameplayRng, cosmetic effects from a separate stream of the same seed
+    uint64_t                Seed;
+    Random                  GameplayRng;
+
+    // running totals, read by external drivers such as BatchEnv
+    unsigned int            Score;      // bricks destroyed
+    unsigned int            BallsLost;
+    uint64_t                Ticks;      // completed calls to Step
 
-    Game(unsigned int width, unsigned int height);
+    std::unique_ptr<SpriteRenderer>     Renderer;
+    std::unique_ptr<ParticleSystem>     Particles;
+    std::unique_ptr<PostProcessor>      Effects;
+
+    Game(unsigned int width, unsigned int height, uint64_t seed = 0);
     ~Game();
 
-    void Init();
+    Game(const Game &) = delete;
+    Game &operator=(const Game &) = delete;
+    Game(Game &&other);
+
+    void Init(bool headless = false);
 
     // game loop
+    void Step(float dt);            // one fixed simulation tick: input, then update
     void ProcessInput(float dt);
     void Update(float dt);
-    void Render();
+    void Render(float alpha = 1.0f);  // alpha: fraction of a tick elapsed since the last Step
+
+    // hash of the simulation state (not render state), used to detect replay divergence
+    uint32_t Checksum() const;
     void DoCollisions();
 
     // reset
@@ -51,8 +101,21 @@ public:
     void ResetPlayer();
 
     // power up
-    void SpawnPowerUps(GameObject &block);
+    void SpawnPowerUps(glm::vec2 position);
+    void ActivatePowerUp(PowerUp &powerUp);
     void UpdatePowerUps(GLfloat dt);
+
+private:
+    Texture2D               powerUpTextures[POWERUP_TYPE_COUNT];
+    unsigned int            trailEmitter;   // the ball trail in Particles, fed the ball's motion every update
+
+    void initRenderData();
+    // ball-brick collisions through the grid and the SIMD kernel, or brick by brick
+    void collideBricks();
+    void collideBricksReference();
+    // applies a hit on brick i; true if it pushed the ball out of the brick
+    bool resolveBrickHit(unsigned int i, const Collision &res);
+    void burst(glm::vec2 center, glm::vec3 color, unsigned int count, float speed, float life);
 };
 
 #endif
@@ -0,0 +1,129 @@
+#include <glad/glad.h>
+
+#include "gl_state.h"
+
+
+// nothing is known about a thread's context until the first call sets it
+static const unsigned int kUnknown = ~0u;
+
+thread_local unsigned int GLState::Issued = 0;
+thread_local unsigned int GLState::Elided = 0;
+
+thread_local unsigned int GLState::program = kUnknown;
+thread_local unsigned int GLState::activeUnit = kUnknown;
+thread_local unsigned int GLState::vao = kUnknown;
+thread_local unsigned int GLState::arrayBuffer = kUnknown;
+thread_local unsigned int GLState::uniformBuffer = kUnknown;
+thread_local unsigned int GLState::textures[GLState::kTextureUnits] = {
+    kUnknown, kUnknown, kUnknown, kUnknown, kUnknown, kUnknown, kUnknown, kUnknown,
+    kUnknown, kUnknown, kUnknown, kUnknown, kUnknown, kUnknown, kUnknown, kUnknown
+};
+thread_local unsigned int GLState::readFramebuffer = kUnknown;
+thread_local unsigned int GLState::drawFramebuffer = kUnknown;
+thread_local unsigned int GLState::blendSrc = kUnknown;
+thread_local unsigned int GLState::blendDst = kUnknown;
+
+
+bool GLState::changed(unsigned int &cached, unsigned int value) {
+    if (cached == value) {
+        ++Elided;
+        return false;
+    }
+    cached = value;
+    ++Issued;
+    return true;
+}
+
+
+void GLState::UseProgram(unsigned int program) {
+    if (changed(GLState::program, program))
+        glUseProgram(program);
+}
+
+
+void GLState::ActiveTexture(unsigned int unit) {
+    if (changed(activeUnit, unit))
+        glActiveTexture(unit);
+}
+
+
+void GLState::BindTexture(unsigned int target, unsigned int texture) {
+    // only 2D bindings on the first units are tracked
+    unsigned int unit = activeUnit - GL_TEXTURE0;
+    if (target != GL_TEXTURE_2D || activeUnit == kUnknown || unit >= kTextureUnits) {
+        ++Issued;
+        glBindTexture(target, texture);
+        return;
+    }
+    if (changed(textures[unit], texture))
+        glBindTexture(target, texture);
+}
+
+
+void GLState::BindVertexArray(unsigned int vao) {
+    if (changed(GLState::vao, vao))
+        glBindVertexArray(vao);
+}
+
+
+void GLState::BindBuffer(unsigned int target, unsigned int buffer) {
+    // other targets are either per-VAO state or rarely bound, pass them through
+    unsigned int *cached = target == GL_ARRAY_BUFFER ? &arrayBuffer : target == GL_UNIFORM_BUFFER ? &uniformBuffer : nullptr;
+    if (!cached) {
+        ++Issued;
+        glBindBuffer(target, buffer);
+        return;
+    }
+    if (changed(*cached, buffer))
+        glBindBuffer(target, buffer);
+}
+
+
+void GLState::BindBufferBase(unsigned int target, unsigned int index, unsigned int buffer) {
+    // indexed bindings are not cached, but the generic one they overwrite is
+    if (target == GL_UNIFORM_BUFFER)
+        uniformBuffer = buffer;
+    ++Issued;
+    glBindBufferBase(target, index, buffer);
+}
+
+
+void GLState::BindFramebuffer(unsigned int target, unsigned int framebuffer) {
+    if (target == GL_READ_FRAMEBUFFER) {
+        if (changed(readFramebuffer, framebuffer))
+            glBindFramebuffer(target, framebuffer);
+    }
+    else if (target == GL_DRAW_FRAMEBUFFER) {
+        if (changed(drawFramebuffer, framebuffer))
+            glBindFramebuffer(target, framebuffer);
+    }
+    else if (readFramebuffer == framebuffer && drawFramebuffer == framebuffer) {
+        ++Elided;
+    }
+    else {
+        readFramebuffer = drawFramebuffer = framebuffer;
+        ++Issued;
+        glBindFramebuffer(target, framebuffer);
+    }
+}
+
+
+void GLState::BlendFunc(unsigned int sfactor, unsigned int dfactor) {
+    if (blendSrc == sfactor && blendDst == dfactor) {
+        ++Elided;
+        return;
+    }
+    blendSrc = sfactor;
+    blendDst = dfactor;
+    ++Issued;
+    glBlendFunc(sfactor, dfactor);
+}
+
+
+void GLState::Invalidate() {
+    program = activeUnit = vao = arrayBuffer = uniformBuffer = kUnknown;
+    for (unsigned int &texture : textures)
+        texture = kUnknown;
+    readFramebuffer = drawFramebuffer = kUnknown;
+    blendSrc = blendDst = kUnknown;
+}
@@ -0,0 +1,46 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+
+// Remembers the GL bindings it has set and skips calls that would not change
+// anything. Every renderer binds through here, so the cache only stays right
+// as long as nothing calls the wrapped gl* functions directly; after code that
+// does (or after deleting bound objects) call Invalidate.
+//
+// Bindings belong to a context, and a context is current on one thread at a
+// time, so the cache is kept per thread. That matches the contexts as long as
+// each thread keeps its own; after making another context current on a thread
+// call Invalidate there too.
+class GLState {
+public:
+    // state changes passed to GL and skipped since the last ResetStats
+    static thread_local unsigned int Issued, Elided;
+
+    static void UseProgram(unsigned int program);
+    static void ActiveTexture(unsigned int unit);               // GL_TEXTURE0 + n
+    static void BindTexture(unsigned int target, unsigned int texture);
+    static void BindVertexArray(unsigned int vao);
+    static void BindBuffer(unsigned int target, unsigned int buffer);
+    // binds an indexed target, which also sets the target's generic binding
+    static void BindBufferBase(unsigned int target, unsigned int index, unsigned int buffer);
+    static void BindFramebuffer(unsigned int target, unsigned int framebuffer);
+    static void BlendFunc(unsigned int sfactor, unsigned int dfactor);
+
+    // forget every cached binding, the next call of each kind is always issued
+    static void Invalidate();
+    static void ResetStats() { Issued = Elided = 0; }
+
+    GLState() = delete;
+
+private:
+    static const unsigned int kTextureUnits = 16;
+
+    static thread_local unsigned int program, activeUnit, vao, arrayBuffer, uniformBuffer;
+    static thread_local unsigned int textures[kTextureUnits];
+    static thread_local unsigned int readFramebuffer, drawFramebuffer;
+    static thread_local unsigned int blendSrc, blendDst;
+
+    static bool changed(unsigned int &cached, unsigned int value);
+};
+
+#endif
@@ -0,0 +1,216 @@
+#include <glad/glad.h>
+
+#include "gpu_particles.h"
+#include "gl_state.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+
+
+// uniform buffer binding point the emitter block is read from
+const unsigned int kEmitterBinding = 0;
+
+
+GPUParticleGenerator::GPUParticleGenerator(Shader shader, Shader update, Texture2D texture, unsigned int amount, Random random)
+    : amount(std::max(amount, 1u)), limit(this->amount), live(0), next(0), used(0), clock(0.0f), random(random),
+      runs(this->amount), firstRun(0), runCount(0), span(0), frameCost(0.0f),
+      shader(shader), update(update), texture(texture), current(0) {
+    this->block.Spawn[2] = this->amount;
+    this->init();
+}
+
+GPUParticleGenerator::~GPUParticleGenerator() {
+    glDeleteVertexArrays(2, this->updateArrays);
+    glDeleteVertexArrays(2, this->drawArrays);
+    glDeleteBuffers(2, this->buffers);
+    glDeleteBuffers(1, &this->quadVBO);
+    glDeleteBuffers(1, &this->emitterUBO);
+    GLState::Invalidate();
+}
+
+
+void GPUParticleGenerator::init() {
+    float particle_quad[] = {
+        0.0f, 0.0f, 0.0f, 0.0f,
+        0.0f, 1.0f, 0.0f, 1.0f,
+        1.0f, 0.0f, 1.0f, 0.0f,
+        1.0f, 1.0f, 1.0f, 1.0f,
+    };
+    glGenBuffers(1, &this->quadVBO);
+    GLState::BindBuffer(GL_ARRAY_BUFFER, this->quadVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(particle_quad), particle_quad, GL_STATIC_DRAW);
+
+    // slots are only read once something has spawned into them, so the storage starts undefined
+    glGenBuffers(2, this->buffers);
+    glGenVertexArrays(2, this->updateArrays);
+    glGenVertexArrays(2, this->drawArrays);
+    for (unsigned int i = 0; i < 2; ++i) {
+        GLState::BindBuffer(GL_ARRAY_BUFFER, this->buffers[i]);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(GPUParticle) * this->amount, nullptr, GL_DYNAMIC_COPY);
+
+        GLState::BindVertexArray(this->updateArrays[i]);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(GPUParticle), (void *)offsetof(GPUParticle, Position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(GPUParticle), (void *)offsetof(GPUParticle, Velocity));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(GPUParticle), (void *)offsetof(GPUParticle, Color));
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(GPUParticle), (void *)offsetof(GPUParticle, Life));
+
+        // drawn with particle.vs, same attributes as the CPU generator
+        GLState::BindVertexArray(this->drawArrays[i]);
+        GLState::BindBuffer(GL_ARRAY_BUFFER, this->quadVBO);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)0);
+        GLState::BindBuffer(GL_ARRAY_BUFFER, this->buffers[i]);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(GPUParticle), (void *)offsetof(GPUParticle, Position));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(GPUParticle), (void *)offsetof(GPUParticle, Color));
+        glVertexAttribDivisor(1, 1);
+        glVertexAttribDivisor(2, 1);
+    }
+    GLState::BindVertexArray(0);
+
+    glGenBuffers(1, &this->emitterUBO);
+    GLState::BindBuffer(GL_UNIFORM_BUFFER, this->emitterUBO);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(GPUEmitterBlock), nullptr, GL_DYNAMIC_DRAW);
+    unsigned int block = glGetUniformBlockIndex(this->update.ID, "Emitter");
+    if (block == GL_INVALID_INDEX)
+        std::cout << "ERROR::PARTICLES: update shader has no Emitter block" << std::endl;
+    else
+        glUniformBlockBinding(this->update.ID, block, kEmitterBinding);
+}
+
+
+void GPUParticleGenerator::Clear() {
+    // slots past used are never drawn, and every slot below it will be spawned into again
+    this->live = this->next = this->used = 0;
+    this->firstRun = this->runCount = this->span = 0;
+    ParticleSystem::Clear();
+}
+
+
+void GPUParticleGenerator::Update(float dt) {
+    auto start = std::chrono::steady_clock::now();
+    this->block.Spawn[0] = this->next;
+    this->block.Spawn[1] = this->block.Spawn[3] = 0;
+    this->block.Timing = glm::vec4(dt, 0.0f, 0.0f, 0.0f);
+    this->runEmitters(dt);
+
+    if (this->used > 0) {
+        GLState::BindBuffer(GL_UNIFORM_BUFFER, this->emitterUBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, offsetof(GPUEmitterBlock, Runs) + sizeof(GPUSpawnRun) * this->block.Spawn[3], &this->block);
+        GLState::BindBufferBase(GL_UNIFORM_BUFFER, kEmitterBinding, this->emitterUBO);
+
+        // read the current state, capture the next one into the other buffer
+        unsigned int target = 1 - this->current;
+        this->update.Use();
+        GLState::BindVertexArray(this->updateArrays[this->current]);
+        GLState::BindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, this->buffers[target]);
+        this->updateTimer.Begin();
+        glEnable(GL_RASTERIZER_DISCARD);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, this->used);
+        glEndTransformFeedback();
+        glDisable(GL_RASTERIZER_DISCARD);
+        this->updateTimer.End();
+        GLState::BindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        this->current = target;
+    }
+
+    // the shader aged every particle by dt, retire the runs that ran out
+    this->clock += dt;
+    for (unsigned int k = 0; k < this->runCount; ++k) {
+        spawnRun &run = this->runs[(this->firstRun + k) % this->amount];
+        if (run.Live > 0 && run.Expires <= this->clock)
+            this->kill(run, run.Live);
+    }
+    // dead runs at the front may be overwritten freely, they stop counting towards the span
+    while (this->runCount > 0 && this->runs[this->firstRun].Live == 0) {
+        this->span -= this->runs[this->firstRun].Slots;
+        this->firstRun = (this->firstRun + 1) % this->amount;
+        --this->runCount;
+    }
+    this->releaseEmitters();
+
+    this->frameCost += std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+unsigned int GPUParticleGenerator::spawn(unsigned int slot, glm::vec2 position, glm::vec2 velocity, unsigned int count) {
+    const ParticleEmitter &emitter = this->emitters[slot].Emitter;
+    if (this->span + count > this->amount)
+        this->overwrite(this->span + count - this->amount);
+
+    GPUSpawnRun &run = this->block.Runs[this->block.Spawn[3]++];
+    // the shader moves particles against their stored velocity, like the CPU kernel
+    run.Origin = glm::vec4(position, -velocity);
+    run.Color = glm::vec4(emitter.Color, emitter.Life);
+    run.Shape = glm::vec4(emitter.Spread, emitter.Speed, 0.0f, 0.0f);
+    run.Span[0] = this->block.Spawn[1];
+    run.Span[1] = count;
+    run.Span[2] = this->random.Next();
+    this->block.Spawn[1] += count;
+
+    this->runs[(this->firstRun + this->runCount) % this->amount] = { slot, count, count, this->clock + emitter.Life };
+    ++this->runCount;
+    this->span += count;
+    this->next = (this->next + count) % this->amount;
+    this->used = std::min(this->used + count, this->amount);
+    this->live += count;
+    return count;
+}
+
+
+void GPUParticleGenerator::overwrite(unsigned int count) {
+    while (count > 0 && this->runCount > 0) {
+        spawnRun &run = this->runs[this->firstRun];
+        unsigned int slots = std::min(count, run.Slots);
+        this->kill(run, std::min(slots, run.Live));
+        run.Slots -= slots;
+        this->span -= slots;
+        count -= slots;
+        if (run.Slots == 0) {
+            this->firstRun = (this->firstRun + 1) % this->amount;
+            --this->runCount;
+        }
+    }
+}
+
+
+void GPUParticleGenerator::kill(spawnRun &run, unsigned int count) {
+    run.Live -= count;
+    this->emitters[run.Emitter].Live -= count;
+    this->live -= count;
+}
+
+
+void GPUParticleGenerator::Draw() {
+    // the GPU time of earlier frames' update and draw, whichever have finished
+    this->updateTimer.Poll();
+    this->drawTimer.Poll();
+
+    if (this->live > 0) {
+        // additive like the CPU generator, dead slots are transparent and add nothing
+        GLState::BlendFunc(GL_SRC_ALPHA, GL_ONE);
+        this->shader.Use();
+        this->texture.Bind();
+        GLState::BindVertexArray(this->drawArrays[this->current]);
+        this->drawTimer.Begin();
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, this->used);
+        this->drawTimer.End();
+    }
+    else {
+        // nothing to update or draw, nothing for the GPU to charge
+        this->updateTimer.Seconds = this->drawTimer.Seconds = 0.0f;
+    }
+
+    // a frame ends with its draw: hand its cost to the budget and apply any new scale
+    if (this->Budget.Frame((this->frameCost + this->updateTimer.Seconds + this->drawTimer.Seconds) * 1000.0f))
+        this->limit = std::max(1u, (unsigned int)(this->amount * this->Budget.Scale));
+    this->frameCost = 0.0f;
+}
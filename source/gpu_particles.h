@@ -0,0 +1,102 @@
+#ifndef GPU_PARTICLES_H
+#define GPU_PARTICLES_H
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "particle.h"
+#include "shader.h"
+#include "texture.h"
+#include "gpu_timer.h"
+#include "random.h"
+
+
+// one particle as stored in the GPU buffers, the layout of particle_update.vs
+struct GPUParticle {
+    glm::vec2 Position, Velocity;
+    glm::vec4 Color;
+    float     Life;
+};
+
+// one emitter's spawns in an update, the SpawnRun struct of particle_update.vs, std140
+struct GPUSpawnRun {
+    glm::vec4    Origin;    // spawn position xy, velocity zw
+    glm::vec4    Color;     // rgb, life of a new particle
+    glm::vec4    Shape;     // spread, speed
+    unsigned int Span[4];   // first spawn of the run within the update, count, seed
+};
+
+// the Emitter uniform block of particle_update.vs, std140
+struct GPUEmitterBlock {
+    unsigned int Spawn[4];  // first slot, spawns in total, capacity, runs
+    glm::vec4    Timing;    // dt
+    GPUSpawnRun  Runs[kMaxEmitters];    // particle_update.vs declares as many
+};
+
+
+// The GPU backend: particles live in two vertex buffers, and each update runs
+// the update shader over one and captures the result into the other with
+// transform feedback. Nothing is read back or uploaded per particle; the CPU
+// only fills the emitter block with what each emitter spawns. New particles
+// take slots round-robin, so the oldest ones go first when it is full.
+//
+// Every particle of a spawn run dies at the same time, so the CPU tracks the
+// runs instead of the particles to know how many are alive, and for which
+// emitter.
+class GPUParticleGenerator : public ParticleSystem {
+public:
+    GPUParticleGenerator(Shader shader, Shader update, Texture2D texture, unsigned int amount, Random random = Random());
+    ~GPUParticleGenerator();
+
+    void Clear() override;
+
+    unsigned int Live() const override { return this->live; }
+    unsigned int Limit() const override { return this->limit; }
+
+    void Update(float dt) override;
+    void Draw() override;
+
+private:
+    // consecutive slots spawned by one emitter in one update
+    struct spawnRun {
+        unsigned int Emitter;
+        unsigned int Slots;     // still ahead of the next spawn, shrinks as they are overwritten
+        unsigned int Live;      // Slots while alive, 0 once dead
+        float        Expires;   // clock at which they die
+    };
+
+    unsigned int amount;
+    unsigned int limit;     // most particles alive at once, amount scaled by the budget
+    unsigned int live;
+    unsigned int next;      // slot the next spawn goes to
+    unsigned int used;      // slots ever spawned into, the ones worth drawing
+    float clock;            // seconds of updates so far
+    Random random;
+
+    // runs in spawn order from the oldest one with anything alive, as a ring
+    std::vector<spawnRun> runs;
+    unsigned int firstRun, runCount;
+    unsigned int span;      // slots from the oldest tracked run up to next
+
+    GPUEmitterBlock block;  // this update's spawns
+    float frameCost;        // CPU seconds spent in Update since the last Draw; the draw itself is timed on the GPU
+    GPUTimer updateTimer, drawTimer;
+
+    Shader shader, update;
+    Texture2D texture;
+
+    unsigned int quadVBO;
+    unsigned int buffers[2];        // particle state, ping-ponged every update
+    unsigned int updateArrays[2];   // read buffers[i] as update input
+    unsigned int drawArrays[2];     // read buffers[i] as instances
+    unsigned int current;           // which buffer holds the latest state
+    unsigned int emitterUBO;
+
+    void init();
+    unsigned int spawn(unsigned int slot, glm::vec2 position, glm::vec2 velocity, unsigned int count) override;
+    // drops count slots from the oldest runs, killing whatever is still alive in them
+    void overwrite(unsigned int count);
+    void kill(spawnRun &run, unsigned int count);
+};
+
+#endif
@@ -0,0 +1,47 @@
+#include <glad/glad.h>
+
+#include "gpu_timer.h"
+
+
+GPUTimer::GPUTimer() : Seconds(0.0f), next(0), active(false) {
+    glGenQueries(kStreamSegments, this->queries);
+    for (unsigned int i = 0; i < kStreamSegments; ++i)
+        this->pending[i] = false;
+}
+
+GPUTimer::~GPUTimer() {
+    glDeleteQueries(kStreamSegments, this->queries);
+}
+
+
+void GPUTimer::Poll() {
+    for (unsigned int i = 0; i < kStreamSegments; ++i) {
+        if (!this->pending[i])
+            continue;
+        int available = 0;
+        glGetQueryObjectiv(this->queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available)
+            continue;
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(this->queries[i], GL_QUERY_RESULT, &elapsed);
+        this->Seconds = elapsed * 1e-9f;
+        this->pending[i] = false;
+    }
+}
+
+
+void GPUTimer::Begin() {
+    this->active = !this->pending[this->next];
+    if (this->active)
+        glBeginQuery(GL_TIME_ELAPSED, this->queries[this->next]);
+}
+
+
+void GPUTimer::End() {
+    if (!this->active)
+        return;
+    glEndQuery(GL_TIME_ELAPSED);
+    this->pending[this->next] = true;
+    this->next = (this->next + 1) % kStreamSegments;
+    this->active = false;
+}
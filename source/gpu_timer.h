@@ -0,0 +1,33 @@
+#ifndef GPU_TIMER_H
+#define GPU_TIMER_H
+
+#include "stream_buffer.h"
+
+
+// Times a range of GL calls with GL_TIME_ELAPSED queries. There is a query
+// per frame in flight and results are only read once the GPU has finished
+// them, so timing never waits. A range is skipped when every query is still
+// pending.
+class GPUTimer {
+public:
+    float Seconds;      // the latest finished range, refreshed by Poll
+
+    GPUTimer();
+    ~GPUTimer();
+
+    GPUTimer(const GPUTimer &) = delete;
+    GPUTimer &operator=(const GPUTimer &) = delete;
+
+    // picks up whichever results have come in
+    void Poll();
+    void Begin();
+    void End();
+
+private:
+    unsigned int queries[kStreamSegments];
+    bool pending[kStreamSegments];
+    unsigned int next;
+    bool active;        // a query was started by the last Begin
+};
+
+#endif
@@ -1,19 +1,46 @@
+#include <cmath>
 #include <fstream>
 #include <sstream>
 #include <glad/glad.h>
 
 #include "level.h"
+#include "gl_state.h"
+
+
+// The bricks as sprite instances in a GPU buffer. Destroyed bricks stay in the
+// buffer with a zero size, so a hit only rewrites that one instance.
+struct BrickInstances {
+    unsigned int VBO, VAO;
+    unsigned int Count;     // bricks the buffer was sized for
+    std::vector<SpriteInstance> Staging;
+
+    BrickInstances() : VBO(0), VAO(0), Count(0) {}
+    ~BrickInstances() {
+        glDeleteVertexArrays(1, &this->VAO);
+        glDeleteBuffers(1, &this->VBO);
+        GLState::Invalidate();
+    }
+};
+
+
+GameLevel::GameLevel() : GridWidth(0), GridHeight(0), UnitSize(0.0f) {}
+
+// defined here where BrickInstances is complete
+GameLevel::~GameLevel() {}
+GameLevel::GameLevel(GameLevel &&other) = default;
+GameLevel &GameLevel::operator=(GameLevel &&other) = default;
 
 
 void GameLevel::Load(const char *file, unsigned int levelWidth, unsigned int levelHeight) {
-    this->Bricks.clear();
     unsigned int code;
     std::string line;
     std::ifstream fstream(file);
     std::vector<std::vector<unsigned int>> tileData;
 
-    if (!fstream)
+    if (!fstream) {
+        this->Build(tileData, levelWidth, levelHeight);
         return;
+    }
     
     while (std::getline(fstream, line)) {
         std::istringstream sstream(line);
@@ -22,17 +49,30 @@ void GameLevel::Load(const char *file, unsigned int levelWidth, unsigned int lev
             row.push_back(code);
         tileData.push_back(row);
     }
+    this->Build(tileData, levelWidth, levelHeight);
+}
+
+
+void GameLevel::Build(const std::vector<std::vector<unsigned int>> &tileData, unsigned int levelWidth, unsigned int levelHeight) {
+    this->Bricks.Clear();
+    this->Grid.clear();
+    this->GridWidth = this->GridHeight = 0;
     if (tileData.size() > 0)
         this->init(tileData, levelWidth, levelHeight);
 }
 
 
-void GameLevel::init(std::vector<std::vector<unsigned int>> tileData, unsigned int levelWidth, unsigned int levelHeight) {
+void GameLevel::init(const std::vector<std::vector<unsigned int>> &tileData, unsigned int levelWidth, unsigned int levelHeight) {
     unsigned int height = (unsigned int)tileData.size();
     unsigned int width = (unsigned int)tileData[0].size();
     float unit_width = levelWidth / static_cast<float>(width);
     float unit_height = levelHeight / static_cast<float>(height);
 
+    this->GridWidth = width;
+    this->GridHeight = height;
+    this->UnitSize = glm::vec2(unit_width, unit_height);
+    this->Grid.assign(width * height, -1);
+
     for (unsigned int y = 0; y < height; ++y) {
         for (unsigned int x = 0; x < width; ++x) {
 
@@ -41,12 +81,7 @@ void GameLevel::init(std::vector<std::vector<unsigned int>> tileData, unsigned i
 
             // solid
             if (tileData[y][x] == 1) {
-                GameObject obj(pos, size,
-                               ResourceManager::GetTexture("block_solid"),
-                               glm::vec3(0.8f, 0.8f, 0.7f)
-                );
-                obj.IsSolid = true;
-                this->Bricks.push_back(obj);
+                this->Grid[y * width + x] = (int)this->Bricks.Add(pos, size, glm::vec3(0.8f, 0.8f, 0.7f), true);
             }
             // non-solid
             else if (tileData[y][x] > 1) {
@@ -61,23 +96,96 @@ void GameLevel::init(std::vector<std::vector<unsigned int>> tileData, unsigned i
                 else if (tileData[y][x] == 5)
                     color = glm::vec3(1.0f, 0.5f, 0.0f);
 
-                this->Bricks.push_back(GameObject(pos, size, ResourceManager::GetTexture("block"), color));
+                this->Grid[y * width + x] = (int)this->Bricks.Add(pos, size, color, false);
             }
         }
     }
 }
 
 
-bool GameLevel::IsCompleted() {
-    for (GameObject &tile : this->Bricks)
-        if (!tile.IsSolid && !tile.Destroyed)
-            return false;
+bool GameLevel::CellRange(glm::vec2 min, glm::vec2 max, unsigned int &x0, unsigned int &y0, unsigned int &x1, unsigned int &y1) const {
+    if (this->Grid.empty())
+        return false;
+
+    float left   = std::floor(min.x / this->UnitSize.x);
+    float top    = std::floor(min.y / this->UnitSize.y);
+    float right  = std::floor(max.x / this->UnitSize.x);
+    float bottom = std::floor(max.y / this->UnitSize.y);
+
+    if (right < 0.0f || bottom < 0.0f || left >= this->GridWidth || top >= this->GridHeight)
+        return false;
+
+    x0 = left < 0.0f ? 0 : (unsigned int)left;
+    y0 = top < 0.0f ? 0 : (unsigned int)top;
+    x1 = right >= this->GridWidth ? this->GridWidth - 1 : (unsigned int)right;
+    y1 = bottom >= this->GridHeight ? this->GridHeight - 1 : (unsigned int)bottom;
     return true;
 }
 
 
+float GameLevel::Progress() const {
+    if (this->Bricks.Destructible() == 0)
+        return 1.0f;
+    return 1.0f - this->Bricks.Remaining() / (float)this->Bricks.Destructible();
+}
+
+
 void GameLevel::Draw(SpriteRenderer &renderer) {
-    for (GameObject &tile : this->Bricks)
-        if (!tile.Destroyed)
-            tile.Draw(renderer);
+    Texture2D &block = ResourceManager::GetTexture("block");
+    Texture2D &blockSolid = ResourceManager::GetTexture("block_solid");
+
+    // the instance buffer draws every brick with one texture, which needs both in the atlas
+    if (block.ID != blockSolid.ID) {
+        this->drawSprites(renderer, block, blockSolid);
+        return;
+    }
+
+    if (!this->instances) {
+        this->instances.reset(new BrickInstances());
+        glGenBuffers(1, &this->instances->VBO);
+        this->instances->VAO = renderer.CreateInstanceArray(this->instances->VBO);
+    }
+    BrickInstances &gpu = *this->instances;
+
+    unsigned int begin, end;
+    this->Bricks.DirtyRange(begin, end);
+    GLState::BindBuffer(GL_ARRAY_BUFFER, gpu.VBO);
+    if (gpu.Count != this->Bricks.Count()) {
+        gpu.Count = this->Bricks.Count();
+        glBufferData(GL_ARRAY_BUFFER, gpu.Count * sizeof(SpriteInstance), nullptr, GL_DYNAMIC_DRAW);
+        begin = 0;
+        end = gpu.Count;
+    }
+
+    // everything that changed since the last frame goes up in one call
+    if (begin < end) {
+        gpu.Staging.resize(end - begin);
+        for (unsigned int i = begin; i < end; ++i) {
+            SpriteInstance &instance = gpu.Staging[i - begin];
+            glm::vec2 size = this->Bricks.IsDestroyed(i) ? glm::vec2(0.0f) : this->Bricks.Extent(i);
+            instance.Rect = glm::vec4(this->Bricks.Position(i), size);
+            instance.Color = glm::vec4(this->Bricks.Colors[i], 0.0f);
+            instance.UV = this->Bricks.IsSolid(i) ? blockSolid.UV : block.UV;
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, begin * sizeof(SpriteInstance), (end - begin) * sizeof(SpriteInstance), gpu.Staging.data());
+    }
+    this->Bricks.ClearDirty();
+
+    renderer.DrawInstances(block, gpu.VAO, gpu.Count);
+}
+
+
+void GameLevel::drawSprites(SpriteRenderer &renderer, Texture2D &block, Texture2D &blockSolid) {
+    // bricks never overlap, so draw all of one texture first to keep each in a single batch.
+    // walk the destroyed bitset a word at a time, dead bricks are never touched
+    for (int solid = 0; solid < 2; ++solid) {
+        Texture2D &texture = solid ? blockSolid : block;
+        for (size_t word = 0; word < this->Bricks.Destroyed.size(); ++word) {
+            uint64_t alive = ~this->Bricks.Destroyed[word] & (solid ? this->Bricks.Solid[word] : ~this->Bricks.Solid[word]);
+            for (; alive != 0; alive &= alive - 1) {
+                unsigned int i = (unsigned int)(word * 64) + LowestBit(alive);
+                renderer.DrawSprite(texture, this->Bricks.Position(i), this->Bricks.Extent(i), 0.0f, this->Bricks.Colors[i]);
+            }
+        }
+    }
 }
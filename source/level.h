@@ -1,27 +1,54 @@
 #ifndef GAMELEVEL_H
 #define GAMELEVEL_H
 
+#include <memory>
 #include <vector>
 
 #include <glm/glm.hpp>
 
-#include "object.h"
+#include "brick_store.h"
 #include "sprite_renderer.h"
 #include "resource_manager.h"
 
 
+struct BrickInstances;
+
+
 class GameLevel {
 public:
-    std::vector<GameObject> Bricks;
-    GameLevel() {}
+    BrickStore              Bricks;
+
+    // broadphase grid over the brick lattice, one brick index per cell (-1 if empty)
+    std::vector<int>        Grid;
+    unsigned int            GridWidth, GridHeight;
+    glm::vec2               UnitSize;
+
+    GameLevel();
+    ~GameLevel();
+    GameLevel(GameLevel &&other);
+    GameLevel &operator=(GameLevel &&other);
 
     void Load(const char *file, unsigned int levelWidth, unsigned int levelHeight);
+    // same as Load, from tile codes already in memory: one row per line of a level file
+    void Build(const std::vector<std::vector<unsigned int>> &tileData, unsigned int levelWidth, unsigned int levelHeight);
 
+    // bring back every brick destroyed since Load
+    void Reset() { this->Bricks.Restore(); }
+
+    // the first call uploads every brick, later ones only the bricks changed since
     void Draw(SpriteRenderer &renderer);
 
-    bool IsCompleted();
+    bool IsCompleted() const { return this->Bricks.Remaining() == 0; }
+    // fraction of destructible bricks cleared, 0 to 1
+    float Progress() const;
+
+    // inclusive range of grid cells overlapped by the box [min, max], false if it misses the grid
+    bool CellRange(glm::vec2 min, glm::vec2 max, unsigned int &x0, unsigned int &y0, unsigned int &x1, unsigned int &y1) const;
 private:
-    void init(std::vector<std::vector<unsigned int>> tileData, unsigned int levelWidth, unsigned int levelHeight);
+    std::unique_ptr<BrickInstances> instances;  // GPU copy of the bricks, null until the first Draw
+
+    void drawSprites(SpriteRenderer &renderer, Texture2D &block, Texture2D &blockSolid);
+    void init(const std::vector<std::vector<unsigned int>> &tileData, unsigned int levelWidth, unsigned int levelHeight);
 };
 
 #endif
@@ -1,30 +1,100 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+#include "alloc_counter.h"
+#include "batch_env.h"
 #include "game.h"
+#include "gl_state.h"
+#include "gpu_particles.h"
+#include "particle.h"
+#include "replay.h"
+#include "thread_pool.h"
 #include "resource_manager.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <thread>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode);
+void run_game(GLFWwindow* window, const char *recordFile, bool gpuParticles);
+int  run_headless(unsigned long long ticks);
+int  run_collisions(unsigned int maxBricks);
+int  run_replay(const char *file);
+int  run_collision_check(const char *file);
+int  run_batch(unsigned int envs, unsigned int ticks, unsigned int maxThreads);
+int  run_particles(unsigned int count, unsigned int ticks);
+void run_gpu_particles(unsigned int count, unsigned int frames);
+int  run_particle_readback();
+int  run_particle_scaling(unsigned int count, unsigned int ticks, unsigned int maxThreads);
 
 const unsigned int SCREEN_WIDTH = 800;
 const unsigned int SCREEN_HEIGHT = 600;
 
-Game Breakout(SCREEN_WIDTH, SCREEN_HEIGHT);
+const double       TICK_RATE = 120.0;           // simulation steps per second
+const unsigned int MAX_STEPS_PER_FRAME = 8;     // catch-up cap after a long hitch
+const int          SWAP_INTERVAL = 1;           // 0 renders uncapped, 1 waits for vsync
+const uint32_t     REPLAY_CHECKSUM_INTERVAL = 60;   // ticks between recorded state checksums
+const unsigned int HEADLESS_WARMUP_TICKS = 1200;    // ticks before the headless run counts allocations
 
+// what the window callbacks act on
+struct Session {
+    Game   *game;
+    Replay *recording;  // null unless --record was given
+};
 
 int main(int argc, char *argv[]) {
+    // breakout --headless [ticks]: step the simulation without a window or GL context
+    if (argc > 1 && std::strcmp(argv[1], "--headless") == 0)
+        return run_headless(argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 1000000);
+    // breakout --collisions [max]: DoCollisions cost on generated levels of 78 up to max bricks
+    if (argc > 1 && std::strcmp(argv[1], "--collisions") == 0)
+        return run_collisions(argc > 2 ? std::atoi(argv[2]) : 100000);
+    // breakout --batch [envs] [ticks] [threads]: env-steps/sec of BatchEnv for 1..threads workers
+    if (argc > 1 && std::strcmp(argv[1], "--batch") == 0)
+        return run_batch(argc > 2 ? std::atoi(argv[2]) : 1024,
+                         argc > 3 ? std::atoi(argv[3]) : 2000,
+                         argc > 4 ? std::atoi(argv[4]) : std::max(1u, std::thread::hardware_concurrency()));
+    // breakout --particles [count] [ticks]: particle update cost, SoA kernel against the old AoS loop
+    if (argc > 1 && std::strcmp(argv[1], "--particles") == 0)
+        return run_particles(argc > 2 ? std::atoi(argv[2]) : 1000000, argc > 3 ? std::atoi(argv[3]) : 100);
+    // breakout --particles-scaling [count] [ticks] [threads]: threaded particle update from 1 to threads workers
+    if (argc > 1 && std::strcmp(argv[1], "--particles-scaling") == 0)
+        return run_particle_scaling(argc > 2 ? std::atoi(argv[2]) : 1000000,
+                                    argc > 3 ? std::atoi(argv[3]) : 100,
+                                    argc > 4 ? std::atoi(argv[4]) : std::max(1u, std::thread::hardware_concurrency()));
+    // breakout --replay file: re-run a recording headless and check it for divergence
+    if (argc > 2 && std::strcmp(argv[1], "--replay") == 0)
+        return run_replay(argv[2]);
+
+    if (argc > 2 && std::strcmp(argv[1], "--collision-check") == 0)
+        return run_collision_check(argv[2]);
+    // breakout --record file: play normally and record every key transition
+    const char *recordFile = argc > 2 && std::strcmp(argv[1], "--record") == 0 ? argv[2] : nullptr;
+    // breakout --gpu-particles [count] [frames]: particle update and draw cost, transform feedback against the CPU generator
+    bool gpuParticles = argc > 1 && std::strcmp(argv[1], "--gpu-particles") == 0;
+    // breakout --play-gpu-particles: play with the particles simulated by transform feedback
+    bool playGPUParticles = argc > 1 && std::strcmp(argv[1], "--play-gpu-particles") == 0;
+    // breakout --particle-readback: draw particles of known colors offscreen and check the pixels, non-zero exit on a mismatch
+    bool particleReadback = argc > 1 && std::strcmp(argv[1], "--particle-readback") == 0;
+
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     glfwWindowHint(GLFW_RESIZABLE, false);
+    // frames without post-processing effects are drawn straight into the window, multisampled like the effects framebuffer
+    glfwWindowHint(GLFW_SAMPLES, 4);
 
     GLFWwindow* window = glfwCreateWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Breakout", nullptr, nullptr);
     glfwMakeContextCurrent(window);
+    glfwSwapInterval(SWAP_INTERVAL);
 
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
         std::cout << "Failed to initialize GLAD" << std::endl;
@@ -36,46 +106,506 @@ int main(int argc, char *argv[]) {
 
     glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
     glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    GLState::BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    Breakout.Init();
+    int result = 0;
+    if (gpuParticles)
+        run_gpu_particles(argc > 2 ? std::atoi(argv[2]) : 200000, argc > 3 ? std::atoi(argv[3]) : 100);
+    else if (particleReadback)
+        result = run_particle_readback();
+    else
+        run_game(window, recordFile, playGPUParticles);
+
+    ResourceManager::Clear();
+
+    glfwTerminate();
+    return result;
+}
 
-    float deltaTime = 0.0f;
-    float lastFrame = 0.0f;
+
+// the game lives on this stack frame so it is torn down while the GL context still exists
+void run_game(GLFWwindow* window, const char *recordFile, bool gpuParticles) {
+    Game breakout(SCREEN_WIDTH, SCREEN_HEIGHT);
+    breakout.GPUParticles = gpuParticles;
+    Replay recording(breakout.Seed, TICK_RATE, REPLAY_CHECKSUM_INTERVAL);
+    Session session = { &breakout, recordFile ? &recording : nullptr };
+    glfwSetWindowUserPointer(window, &session);
+    breakout.Init();
+    ThreadPool particlePool(std::max(1u, std::thread::hardware_concurrency()));
+    breakout.Particles->SetThreadPool(&particlePool);
+
+    // the simulation always advances in fixed ticks, rendering interpolates
+    // between the last two ticks with whatever time is left over
+    const double tickTime = 1.0 / TICK_RATE;
+    double accumulator = 0.0;
+    double lastFrame = glfwGetTime();
+
+    // frame stats shown in the title bar, refreshed once a second
+    double statsStart = lastFrame;
+    unsigned int statsFrames = 0;
 
     while (!glfwWindowShouldClose(window)) {
-        float currentFrame = (float)glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
+        double currentFrame = glfwGetTime();
+        accumulator += currentFrame - lastFrame;
         lastFrame = currentFrame;
         glfwPollEvents();
 
-        Breakout.ProcessInput(deltaTime);
-
-        Breakout.Update(deltaTime);
+        unsigned int steps = 0;
+        while (accumulator >= tickTime && steps < MAX_STEPS_PER_FRAME) {
+            breakout.Step((float)tickTime);
+            if (session.recording)
+                session.recording->AfterStep(breakout);
+            accumulator -= tickTime;
+            ++steps;
+        }
+        // too far behind: drop the backlog instead of spiralling
+        if (accumulator >= tickTime)
+            accumulator = 0.0;
 
         glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT);
-        Breakout.Render();
+        breakout.Render((float)(accumulator / tickTime));
+
+        ++statsFrames;
+        if (currentFrame - statsStart >= 1.0 && breakout.Renderer) {
+            char title[224];
+            std::snprintf(title, sizeof(title), "Breakout | %.0f fps | %u sprite draws, %u state changes (%u skipped) per frame"
+                          " | particles %u/%u, %.0f%% budget, %.2f ms",
+                          statsFrames / (currentFrame - statsStart), breakout.Renderer->DrawCalls / statsFrames,
+                          GLState::Issued / statsFrames, GLState::Elided / statsFrames,
+                          breakout.Particles->Live(), breakout.Particles->Limit(),
+                          breakout.Particles->Budget.Scale * 100.0f, breakout.Particles->Budget.CostMs);
+            glfwSetWindowTitle(window, title);
+            breakout.Renderer->ResetStats();
+            GLState::ResetStats();
+            statsStart = currentFrame;
+            statsFrames = 0;
+        }
 
         glfwSwapBuffers(window);
     }
 
-    ResourceManager::Clear();
-
-    glfwTerminate();
-    return 0;
+    glfwSetWindowUserPointer(window, nullptr);
+    if (session.recording)
+        session.recording->Save(recordFile);
 }
 
 
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode) {
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
-    if (key >= 0 && key < 1024) {
-        if (action == GLFW_PRESS)
-            Breakout.Keys[key] = true;
-        else if (action == GLFW_RELEASE)
-            Breakout.Keys[key] = false;
+    Session *session = static_cast<Session *>(glfwGetWindowUserPointer(window));
+    if (session && key >= 0 && key < (int)KEY_COUNT && action != GLFW_REPEAT) {
+        bool pressed = action == GLFW_PRESS;
+        if (session->recording)
+            session->recording->RecordKey(*session->game, key, pressed);
+        session->game->Keys[key] = pressed;
+    }
+}
+
+
+int run_headless(unsigned long long ticks) {
+    Game breakout(SCREEN_WIDTH, SCREEN_HEIGHT);
+    breakout.Init(true);
+
+    // scripted input: keep launching the ball and sweep the paddle across the screen
+    const unsigned long long sweepTicks = (unsigned long long)(TICK_RATE * 2.0);
+    const float tickTime = (float)(1.0 / TICK_RATE);
+
+    // allocations are only counted once the warm-up ticks have filled every pool
+    const unsigned long long warmupTicks = std::min(ticks, (unsigned long long)HEADLESS_WARMUP_TICKS);
+    uint64_t warmAllocations = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned long long tick = 0; tick < ticks; ++tick) {
+        if (tick == warmupTicks)
+            warmAllocations = AllocationCounter::Count();
+        bool right = (tick / sweepTicks) % 2 == 0;
+        breakout.Keys[GLFW_KEY_SPACE] = true;
+        breakout.Keys[GLFW_KEY_D] = right;
+        breakout.Keys[GLFW_KEY_A] = !right;
+        breakout.Step(tickTime);
     }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    uint64_t allocations = warmupTicks < ticks ? AllocationCounter::Count() - warmAllocations : 0;
+
+    std::cout << "headless: " << ticks << " ticks in " << elapsed.count() << " s ("
+              << (elapsed.count() > 0.0 ? ticks / elapsed.count() : 0.0) << " ticks/s)" << std::endl;
+    if (AllocationCounter::Enabled())
+        std::cout << "headless: " << allocations << " allocations in " << ticks - warmupTicks
+                  << " ticks after warm-up" << std::endl;
+    return 0;
+}
+
+
+// Every level keeps the usual brick size and grows the playfield instead, so
+// only the brick count changes. The ball is dropped at random points of the
+// brick area, one DoCollisions call each; bricks come back between batches.
+int run_collisions(unsigned int maxBricks) {
+    const unsigned int sizes[][2] = { { 13, 6 }, { 40, 25 }, { 100, 100 }, { 400, 250 } };     // 78, 1k, 10k, 100k
+    const glm::vec2 brickSize(50.0f, 25.0f);
+    const unsigned int batches = 4000, batchCalls = 20;
+
+    for (const auto &size : sizes) {
+        unsigned int columns = size[0], rows = size[1];
+        if (columns * rows > maxBricks)
+            break;
+
+        unsigned int levelWidth = (unsigned int)(columns * brickSize.x), levelHeight = (unsigned int)(rows * brickSize.y);
+        Game breakout(levelWidth, levelHeight * 2, 1);
+        breakout.Init(true);
+
+        // solid bricks one time in ten, the rest any of the four colors
+        Random random(columns * rows);
+        std::vector<std::vector<unsigned int>> tiles(rows, std::vector<unsigned int>(columns));
+        for (auto &row : tiles)
+            for (unsigned int &tile : row)
+                tile = random.Below(10) == 0 ? 1 : 2 + random.Below(4);
+        breakout.Levels[breakout.Level].Build(tiles, levelWidth, levelHeight);
+
+        std::chrono::duration<double> elapsed(0.0);
+        for (unsigned int batch = 0; batch < batches; ++batch) {
+            breakout.ResetLevel();
+            breakout.PowerUps.Clear();
+            auto start = std::chrono::steady_clock::now();
+            for (unsigned int call = 0; call < batchCalls; ++call) {
+                breakout.Ball.Position = glm::vec2(random.Float() * levelWidth, random.Float() * levelHeight);
+                breakout.Ball.Velocity = glm::vec2(100.0f, -350.0f);
+                breakout.DoCollisions();
+            }
+            elapsed += std::chrono::steady_clock::now() - start;
+        }
+
+        std::printf("collisions: %6u bricks %8.1f ns/call\n", columns * rows, elapsed.count() * 1e9 / ((double)batches * batchCalls));
+    }
+    return 0;
+}
+
+
+int run_replay(const char *file) {
+    Replay replay;
+    if (!replay.Load(file, TICK_RATE))
+        return 1;
+
+    Game breakout(SCREEN_WIDTH, SCREEN_HEIGHT, replay.Seed);
+    breakout.Init(true);
+
+    uint64_t divergedAt = 0;
+    auto start = std::chrono::steady_clock::now();
+    bool matched = replay.Play(breakout, divergedAt);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    if (!matched) {
+        std::cout << "replay: diverged at tick " << divergedAt << " of " << replay.Ticks << std::endl;
+        return 1;
+    }
+    std::cout << "replay: " << replay.Ticks << " ticks, " << replay.Events.size() << " events, "
+              << replay.Checksums.size() << " checksums matched in " << elapsed.count() << " s" << std::endl;
+    return 0;
+}
+
+
+// plays a recording twice in lockstep, once through the grid and SIMD kernel and
+// once brick by brick, and fails on the first tick the two games disagree
+int run_collision_check(const char *file) {
+    Replay replay;
+    if (!replay.Load(file, TICK_RATE))
+        return 1;
+
+    Game fast(SCREEN_WIDTH, SCREEN_HEIGHT, replay.Seed);
+    Game reference(SCREEN_WIDTH, SCREEN_HEIGHT, replay.Seed);
+    fast.Init(true);
+    reference.Init(true);
+    reference.ReferenceCollisions = true;
+
+    const float tickTime = (float)(1.0 / TICK_RATE);
+    size_t event = 0;
+    while (fast.Ticks < replay.Ticks) {
+        for (; event < replay.Events.size() && replay.Events[event].Tick == fast.Ticks; ++event)
+            fast.Keys[replay.Events[event].Key] = reference.Keys[replay.Events[event].Key] = replay.Events[event].Pressed;
+
+        fast.Step(tickTime);
+        reference.Step(tickTime);
+        if (fast.Checksum() != reference.Checksum()) {
+            std::cout << "collision-check: fast and reference collisions disagree at tick " << fast.Ticks
+                      << " of " << replay.Ticks << std::endl;
+            return 1;
+        }
+    }
+    std::cout << "collision-check: " << replay.Ticks << " ticks, " << fast.Score << " bricks, fast and reference collisions agree" << std::endl;
+    return 0;
+}
+
+
+int run_batch(unsigned int envs, unsigned int ticks, unsigned int maxThreads) {
+    std::vector<int> actions(envs, ACTION_NONE);
+
+    for (unsigned int threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+        BatchEnv env(envs, threads, SCREEN_WIDTH, SCREEN_HEIGHT, (float)(1.0 / TICK_RATE));
+
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int tick = 0; tick < ticks; ++tick) {
+            // simple tracking policy: launch when stuck, keep the paddle under the ball
+            for (unsigned int i = 0; i < envs; ++i) {
+                const float *obs = &env.Observations[i * kObservationSize];
+                float paddleCenter = obs[4] + obs[5] * 0.5f;
+                if (obs[6] > 0.0f)
+                    actions[i] = ACTION_LAUNCH;
+                else
+                    actions[i] = obs[0] < paddleCenter ? ACTION_LEFT : ACTION_RIGHT;
+            }
+            env.Step(actions.data());
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        double steps = (double)envs * ticks;
+        std::cout << "batch: " << envs << " envs, " << threads << " threads: "
+                  << (elapsed.count() > 0.0 ? steps / elapsed.count() : 0.0) << " env-steps/s" << std::endl;
+        if (threads >= maxThreads)
+            break;
+    }
+    return 0;
+}
+
+
+// the array-of-structs particle and update loop ParticleStore replaced, kept as the benchmark baseline
+struct AosParticle {
+    glm::vec2 Position, Velocity;
+    glm::vec4 Color;
+    float Life;
+};
+
+int run_particles(unsigned int count, unsigned int ticks) {
+    const float tickTime = (float)(1.0 / TICK_RATE);
+    // every particle outlives the run, the worst case for the update
+    const float life = ticks * tickTime + 1.0f;
+
+    Random random(1);
+    std::vector<AosParticle> aos(count);
+    ParticleStore soa(count);
+    for (unsigned int i = 0; i < count; ++i) {
+        glm::vec2 position(random.Float() * SCREEN_WIDTH, random.Float() * SCREEN_HEIGHT);
+        glm::vec2 velocity(random.Float() * 20.0f - 10.0f, random.Float() * 20.0f - 10.0f);
+        aos[i].Position = position;
+        aos[i].Velocity = velocity;
+        aos[i].Color = glm::vec4(1.0f);
+        aos[i].Life = life;
+        unsigned int slot = soa.Spawn();
+        if (slot == kNoParticle)
+            continue;
+        soa.X[slot] = position.x;
+        soa.Y[slot] = position.y;
+        soa.VX[slot] = velocity.x;
+        soa.VY[slot] = velocity.y;
+        soa.Life[slot] = life;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int tick = 0; tick < ticks; ++tick) {
+        for (unsigned int i = 0; i < count; ++i) {
+            AosParticle &p = aos[i];
+            p.Life -= tickTime;
+            if (p.Life > 0.0f) {
+                p.Position -= p.Velocity * tickTime;
+                p.Color.a -= tickTime * 2.5f;
+            }
+        }
+    }
+    std::chrono::duration<double> aosElapsed = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for (unsigned int tick = 0; tick < ticks; ++tick)
+        soa.Update(tickTime);
+    std::chrono::duration<double> soaElapsed = std::chrono::steady_clock::now() - start;
+
+    double updates = (double)count * ticks;
+    std::cout << "particles: " << count << " x " << ticks << " ticks" << std::endl;
+    std::cout << "particles: AoS loop   " << aosElapsed.count() * 1e9 / updates << " ns/particle, "
+              << aosElapsed.count() * 1e3 / ticks << " ms/tick" << std::endl;
+    std::cout << "particles: SoA kernel " << soaElapsed.count() * 1e9 / updates << " ns/particle, "
+              << soaElapsed.count() * 1e3 / ticks << " ms/tick" << std::endl;
+    return 0;
+}
+
+
+// The same emission and update at every thread count: each run must end with
+// exactly the particles of the single-threaded one, bit for bit.
+int run_particle_scaling(unsigned int count, unsigned int ticks, unsigned int maxThreads) {
+    const float tickTime = (float)(1.0 / TICK_RATE);
+    // a steady stream: spawn what a 0.8 s life lets the pool hold
+    const unsigned int spawnPerTick = std::max(1u, (unsigned int)(count * tickTime / 0.8f));
+
+    ParticleEmitter emitter(EMITTER_CONTINUOUS);
+    emitter.Spread = 200.0f;
+    emitter.Speed = 150.0f;
+    emitter.Life = 0.8f;
+
+    double serial = 0.0;
+    uint32_t expected = 0;
+    bool identical = true;
+    for (unsigned int threads = 1; threads <= std::max(1u, maxThreads); ++threads) {
+        ThreadPool pool(threads);
+        ParticleStore particles(count);
+        Random random(1);
+
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int tick = 0; tick < ticks; ++tick) {
+            uint64_t seed = (uint64_t)random.Next() << 32 | random.Next();
+            particles.Emit(emitter, 0, glm::vec2(SCREEN_WIDTH / 2.0f, SCREEN_HEIGHT / 2.0f), glm::vec2(0.0f), spawnPerTick, seed, &pool);
+            particles.Update(tickTime, &pool);
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        // FNV-1a over the bits of every live particle
+        uint32_t hash = 2166136261u;
+        for (const std::vector<float> *field : { &particles.X, &particles.Y, &particles.VX, &particles.VY, &particles.A, &particles.Life }) {
+            const unsigned char *bytes = reinterpret_cast<const unsigned char *>(field->data());
+            for (size_t i = 0; i < particles.Live * sizeof(float); ++i)
+                hash = (hash ^ bytes[i]) * 16777619u;
+        }
+        if (threads == 1) {
+            serial = elapsed.count();
+            expected = hash;
+        }
+        identical = identical && hash == expected;
+
+        std::printf("particles-scaling: %u threads %8.3f ms/tick  x%.2f  %u live  %08x%s\n", threads,
+                    elapsed.count() * 1e3 / ticks, serial / elapsed.count(), particles.Live, hash,
+                    hash == expected ? "" : "  MISMATCH");
+    }
+    return identical ? 0 : 1;
+}
+
+
+// Checks the particle instance format end to end: particles with known colors
+// go through ParticleGenerator::Draw into an RGBA8 framebuffer, and the pixel at
+// the center of each must come back as its color times its alpha (the
+// generator blends additively onto black).
+int run_particle_readback() {
+    struct Expected {
+        glm::vec2 Position;
+        glm::vec4 Color;
+    };
+    const Expected particles[] = {
+        { glm::vec2(100.0f, 100.0f), glm::vec4(1.0f, 0.0f, 0.0f, 1.0f) },
+        { glm::vec2(300.0f, 150.0f), glm::vec4(0.0f, 1.0f, 0.0f, 1.0f) },
+        { glm::vec2(500.0f, 400.0f), glm::vec4(0.0f, 0.0f, 1.0f, 0.5f) },
+        { glm::vec2(700.0f, 550.0f), glm::vec4(0.2f, 0.4f, 0.6f, 1.0f) },
+    };
+    const int tolerance = 2;    // 8-bit rounding of the color, then of the blend
+
+    ResourceManager::LoadShader("shaders/particle.vs", "shaders/particle.frag", nullptr, "particle");
+    glm::mat4 projection = glm::ortho(0.0f, (float)SCREEN_WIDTH, (float)SCREEN_HEIGHT, 0.0f, -1.0f, 1.0f);
+    ResourceManager::GetShader("particle").Use().SetInteger("sprite", 0);
+    ResourceManager::GetShader("particle").SetMatrix4("projection", projection);
+    // a plain white texture, so the pixels are the particle color alone
+    unsigned char white[4] = { 255, 255, 255, 255 };
+    Texture2D texture;
+    texture.Internal_Format = texture.Image_Format = GL_RGBA;
+    texture.Generate(1, 1, white);
+
+    unsigned int fbo, rbo;
+    glGenFramebuffers(1, &fbo);
+    glGenRenderbuffers(1, &rbo);
+    GLState::BindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, rbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, SCREEN_WIDTH, SCREEN_HEIGHT);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, rbo);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    {
+        ParticleGenerator generator(ResourceManager::GetShader("particle"), texture, 16);
+        ParticleStore &store = generator.Particles();
+        for (const Expected &particle : particles) {
+            unsigned int i = store.Spawn();
+            if (i == kNoParticle)
+                continue;
+            store.X[i] = particle.Position.x;
+            store.Y[i] = particle.Position.y;
+            store.R[i] = particle.Color.r;
+            store.G[i] = particle.Color.g;
+            store.B[i] = particle.Color.b;
+            store.A[i] = particle.Color.a;
+            store.Life[i] = 1.0f;
+        }
+        generator.Draw();
+    }
+
+    bool ok = true;
+    for (const Expected &particle : particles) {
+        // particles are 10 pixels square from their position, and rows are read bottom up
+        int x = (int)particle.Position.x + 5, y = SCREEN_HEIGHT - 1 - ((int)particle.Position.y + 5);
+        unsigned char pixel[4];
+        glReadPixels(x, y, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, pixel);
+        glm::vec3 rgb = glm::vec3(particle.Color.r, particle.Color.g, particle.Color.b) * particle.Color.a;
+        int expected[3] = { (int)(rgb.r * 255.0f + 0.5f), (int)(rgb.g * 255.0f + 0.5f), (int)(rgb.b * 255.0f + 0.5f) };
+        bool match = true;
+        for (int c = 0; c < 3; ++c)
+            match = match && std::abs(pixel[c] - expected[c]) <= tolerance;
+        std::printf("particle-readback: (%d, %d) read %3u %3u %3u, expected %3d %3d %3d%s\n", x, y, pixel[0], pixel[1], pixel[2],
+                    expected[0], expected[1], expected[2], match ? "" : "  MISMATCH");
+        ok = ok && match;
+    }
+
+    GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &fbo);
+    glDeleteRenderbuffers(1, &rbo);
+    glDeleteTextures(1, &texture.ID);
+    GLState::Invalidate();
+    return ok ? 0 : 1;
+}
+
+
+// both generators keep count particles alive, each frame is one tick of update plus the draw
+void run_gpu_particles(unsigned int count, unsigned int frames) {
+    const float tickTime = (float)(1.0 / TICK_RATE);
+    // a particle lives 0.8 s, spawn enough to keep every slot busy
+    const unsigned int spawnPerTick = std::max(1u, (unsigned int)(count * tickTime / 0.8f));
+
+    ResourceManager::LoadShader("shaders/particle.vs", "shaders/particle.frag", nullptr, "particle");
+    ResourceManager::LoadFeedbackShader("shaders/particle_update.vs", { "outPosition", "outVelocity", "outColor", "outLife" }, "particle_update");
+    ResourceManager::LoadTexture("textures/particle.png", true, "particle");
+    glm::mat4 projection = glm::ortho(0.0f, (float)SCREEN_WIDTH, (float)SCREEN_HEIGHT, 0.0f, -1.0f, 1.0f);
+    ResourceManager::GetShader("particle").Use().SetInteger("sprite", 0);
+    ResourceManager::GetShader("particle").SetMatrix4("projection", projection);
+
+    ParticleGenerator cpu(ResourceManager::GetShader("particle"), ResourceManager::GetTexture("particle"), count, Random(1));
+    GPUParticleGenerator gpu(ResourceManager::GetShader("particle"), ResourceManager::GetShader("particle_update"),
+                             ResourceManager::GetTexture("particle"), count, Random(1));
+    GameObject emitter(glm::vec2(SCREEN_WIDTH / 2.0f, SCREEN_HEIGHT / 2.0f), glm::vec2(25.0f), Texture2D(), glm::vec3(1.0f),
+                       glm::vec2(100.0f, -350.0f));
+
+    // both get the same emitter, the full count is measured so the budget must not scale it down
+    ParticleEmitter attached(EMITTER_ATTACHED);
+    attached.Inherit = -0.1f;
+    attached.Spread = 5.0f;
+    attached.Life = 0.8f;
+    attached.Rate = spawnPerTick * (float)TICK_RATE;
+    attached.Budget = count;
+
+    auto measure = [&](ParticleSystem &particles) {
+        particles.Budget.TargetMs = 1e9f;
+        unsigned int attachedEmitter = particles.AddEmitter(attached);
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned int frame = 0; frame < frames; ++frame) {
+            // sweep the emitter around the screen so the particles spread out
+            float angle = frame * tickTime * 2.0f;
+            emitter.Position = glm::vec2(SCREEN_WIDTH / 2.0f + std::cos(angle) * 300.0f, SCREEN_HEIGHT / 2.0f + std::sin(angle) * 200.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            particles.MoveEmitter(attachedEmitter, emitter.Position, emitter.Velocity);
+            particles.Update(tickTime);
+            particles.Draw();
+            glFinish();
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count() * 1e3 / frames;
+    };
+
+    std::cout << "gpu-particles: " << count << " particles x " << frames << " frames, "
+              << spawnPerTick << " spawned per frame" << std::endl;
+    std::cout << "gpu-particles: CPU update + upload " << measure(cpu) << " ms/frame, " << cpu.Live() << " live" << std::endl;
+    std::cout << "gpu-particles: transform feedback  " << measure(gpu) << " ms/frame, " << gpu.Live() << " live" << std::endl;
 }
 
 
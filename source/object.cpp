@@ -4,13 +4,14 @@
 
 
 GameObject::GameObject() 
-    : Position(0.0f, 0.0f), Size(1.0f, 1.0f), Velocity(0.0f), Color(1.0f), Rotation(0.0f), Sprite(), IsSolid(false), Destroyed(false) {}
+    : Position(0.0f, 0.0f), Size(1.0f, 1.0f), Velocity(0.0f), PrevPosition(0.0f, 0.0f), Color(1.0f), Rotation(0.0f), Sprite(), IsSolid(false), Destroyed(false) {}
 
 
 GameObject::GameObject(glm::vec2 pos, glm::vec2 size, Texture2D sprite, glm::vec3 color, glm::vec2 velocity) 
-    : Position(pos), Size(size), Velocity(velocity), Color(color), Rotation(0.0f), Sprite(sprite), IsSolid(false), Destroyed(false) {}
+    : Position(pos), Size(size), Velocity(velocity), PrevPosition(pos), Color(color), Rotation(0.0f), Sprite(sprite), IsSolid(false), Destroyed(false) {}
 
 
-void GameObject::Draw(SpriteRenderer &renderer) {
-    renderer.DrawSprite(this->Sprite, this->Position, this->Size, this->Rotation, this->Color);
+void GameObject::Draw(SpriteRenderer &renderer, float alpha) {
+    glm::vec2 position = glm::mix(this->PrevPosition, this->Position, alpha);
+    renderer.DrawSprite(this->Sprite, position, this->Size, this->Rotation, this->Color);
 }
@@ -10,6 +10,7 @@
 class GameObject {
 public:
     glm::vec2   Position, Size, Velocity;
+    glm::vec2   PrevPosition;   // position at the start of the current tick, for render interpolation
     glm::vec3   Color;
     float       Rotation;
     bool        IsSolid;
@@ -20,7 +21,8 @@ public:
     GameObject();
     GameObject(glm::vec2 pos, glm::vec2 size, Texture2D sprite, glm::vec3 color=glm::vec3(1.0f), glm::vec2 velocity=glm::vec2(0.0f, 0.0f));
 
-    virtual void Draw(SpriteRenderer &renderer);
+    // alpha blends between PrevPosition (0) and Position (1)
+    virtual void Draw(SpriteRenderer &renderer, float alpha = 1.0f);
 };
 
 #endif
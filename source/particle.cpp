@@ -1,17 +1,166 @@
 #include <glad/glad.h>
 
 #include "particle.h"
+#include "gl_state.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
 
 #define OPTIMIZE
 
 
-ParticleGenerator::ParticleGenerator(Shader shader, Texture2D texture, unsigned int amount)
-    : shader(shader), texture(texture), amount(amount) {
-    this->init();
+ParticleStore::ParticleStore(unsigned int capacity) : Live(0), Limit(capacity) {
+    unsigned int padded = (capacity + kParticleLanes - 1) / kParticleLanes * kParticleLanes;
+    this->X.assign(padded, 0.0f);
+    this->Y.assign(padded, 0.0f);
+    this->VX.assign(padded, 0.0f);
+    this->VY.assign(padded, 0.0f);
+    this->R.assign(padded, 1.0f);
+    this->G.assign(padded, 1.0f);
+    this->B.assign(padded, 1.0f);
+    this->A.assign(padded, 1.0f);
+    this->Life.assign(padded, 0.0f);
+    this->Owner.assign(padded, 0);
+}
+
+
+// Branch-free: every lane loses dt of life, then position and alpha only move
+// in lanes that are still alive (the step is masked to zero in dead ones).
+void ParticleStore::Update(float dt, unsigned int begin, unsigned int end) {
+    float fade = dt * 2.5f;
+    unsigned int i = begin;
+#if defined(BREAKOUT_SIMD_AVX)
+    __m256 vdt = _mm256_set1_ps(dt);
+    __m256 vfade = _mm256_set1_ps(fade);
+    __m256 zero = _mm256_setzero_ps();
+    for (; i < end; i += 8) {
+        __m256 life = _mm256_sub_ps(_mm256_loadu_ps(&this->Life[i]), vdt);
+        _mm256_storeu_ps(&this->Life[i], life);
+        __m256 alive = _mm256_cmp_ps(life, zero, _CMP_GT_OQ);
+        __m256 step = _mm256_and_ps(alive, vdt);
+        _mm256_storeu_ps(&this->X[i], _mm256_sub_ps(_mm256_loadu_ps(&this->X[i]), _mm256_mul_ps(_mm256_loadu_ps(&this->VX[i]), step)));
+        _mm256_storeu_ps(&this->Y[i], _mm256_sub_ps(_mm256_loadu_ps(&this->Y[i]), _mm256_mul_ps(_mm256_loadu_ps(&this->VY[i]), step)));
+        _mm256_storeu_ps(&this->A[i], _mm256_sub_ps(_mm256_loadu_ps(&this->A[i]), _mm256_and_ps(alive, vfade)));
+    }
+#elif defined(BREAKOUT_SIMD_SSE)
+    __m128 vdt = _mm_set1_ps(dt);
+    __m128 vfade = _mm_set1_ps(fade);
+    __m128 zero = _mm_setzero_ps();
+    for (; i < end; i += 4) {
+        __m128 life = _mm_sub_ps(_mm_loadu_ps(&this->Life[i]), vdt);
+        _mm_storeu_ps(&this->Life[i], life);
+        __m128 alive = _mm_cmpgt_ps(life, zero);
+        __m128 step = _mm_and_ps(alive, vdt);
+        _mm_storeu_ps(&this->X[i], _mm_sub_ps(_mm_loadu_ps(&this->X[i]), _mm_mul_ps(_mm_loadu_ps(&this->VX[i]), step)));
+        _mm_storeu_ps(&this->Y[i], _mm_sub_ps(_mm_loadu_ps(&this->Y[i]), _mm_mul_ps(_mm_loadu_ps(&this->VY[i]), step)));
+        _mm_storeu_ps(&this->A[i], _mm_sub_ps(_mm_loadu_ps(&this->A[i]), _mm_and_ps(alive, vfade)));
+    }
+#endif
+    for (; i < end; ++i) {
+        this->Life[i] -= dt;
+        if (this->Life[i] > 0.0f) {
+            this->X[i] -= this->VX[i] * dt;
+            this->Y[i] -= this->VY[i] * dt;
+            this->A[i] -= fade;
+        }
+    }
+}
+
+
+void ParticleStore::Update(float dt, ThreadPool *pool, unsigned int *ownerLive) {
+    // the kernel runs whole lane groups, slots past Live are dead or stale either way
+    unsigned int end = (this->Live + kParticleLanes - 1) / kParticleLanes * kParticleLanes;
+    if (pool)
+        pool->ParallelFor(end, kParticleGrain, [this, dt](unsigned int begin, unsigned int end) {
+            this->Update(dt, begin, end);
+        });
+    else
+        this->Update(dt, 0, end);
+    this->Compact(ownerLive);
 }
 
-ParticleGenerator::~ParticleGenerator() {
-    delete (instance_data);
+
+unsigned int ParticleStore::Emit(const ParticleEmitter &emitter, unsigned short owner, glm::vec2 position, glm::vec2 velocity,
+                                 unsigned int count, uint64_t seed, ThreadPool *pool) {
+    count = std::min(count, this->Limit - std::min(this->Live, this->Limit));
+    unsigned int first = this->Live;
+    this->Live += count;
+
+    auto spawn = [&](unsigned int begin, unsigned int end) {
+        Random random(seed, begin / kParticleGrain);
+        for (unsigned int k = begin; k < end; ++k) {
+            glm::vec2 p = position, v = velocity;
+            if (emitter.Spread > 0.0f)
+                p += glm::vec2(random.Float() * 2.0f - 1.0f, random.Float() * 2.0f - 1.0f) * emitter.Spread;
+            if (emitter.Speed > 0.0f) {
+                float angle = random.Float() * 6.2831853f;
+                v += glm::vec2(std::cos(angle), std::sin(angle)) * (random.Float() * emitter.Speed);
+            }
+            float shade = 0.5f + (random.Below(100) / 100.0f);
+
+            unsigned int i = first + k;
+            this->X[i] = p.x;
+            this->Y[i] = p.y;
+            // the kernel moves particles against their velocity
+            this->VX[i] = -v.x;
+            this->VY[i] = -v.y;
+            this->R[i] = emitter.Color.r * shade;
+            this->G[i] = emitter.Color.g * shade;
+            this->B[i] = emitter.Color.b * shade;
+            this->A[i] = 1.0f;
+            this->Life[i] = emitter.Life;
+            this->Owner[i] = owner;
+        }
+    };
+    if (pool)
+        pool->ParallelFor(count, kParticleGrain, spawn);
+    else
+        for (unsigned int begin = 0; begin < count; begin += kParticleGrain)
+            spawn(begin, std::min(count, begin + kParticleGrain));
+    return count;
+}
+
+
+void ParticleStore::Compact(unsigned int *ownerLive) {
+    for (unsigned int i = 0; i < this->Live; ) {
+        if (this->Life[i] > 0.0f) {
+            if (ownerLive)
+                ++ownerLive[this->Owner[i]];
+            ++i;
+        }
+        else
+            this->move(--this->Live, i);    // i now holds the former last particle, test it next
+    }
+}
+
+
+void ParticleStore::move(unsigned int from, unsigned int to) {
+    this->X[to] = this->X[from];
+    this->Y[to] = this->Y[from];
+    this->VX[to] = this->VX[from];
+    this->VY[to] = this->VY[from];
+    this->R[to] = this->R[from];
+    this->G[to] = this->G[from];
+    this->B[to] = this->B[from];
+    this->A[to] = this->A[from];
+    this->Life[to] = this->Life[from];
+    this->Owner[to] = this->Owner[from];
+}
+
+
+// a [0, 1] channel as the byte the GPU normalizes back, out of range values clamp
+static inline unsigned char packUnorm8(float value) {
+    return (unsigned char)(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+
+ParticleGenerator::ParticleGenerator(Shader shader, Texture2D texture, unsigned int amount, Random random)
+    : particles(amount), amount(amount), random(random), emitterLive(kMaxEmitters), pool(nullptr), frameCost(0.0f), shader(shader), texture(texture),
+      stream(sizeof(ParticleInstance) * amount) {
+    this->init();
 }
 
 
@@ -27,89 +176,193 @@ void ParticleGenerator::init() {
 
     glGenVertexArrays(1, &this->VAO);
     glGenBuffers(1, &VBO);
-    glBindVertexArray(this->VAO);
+    GLState::BindVertexArray(this->VAO);
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    GLState::BindBuffer(GL_ARRAY_BUFFER, VBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(particle_quad), particle_quad, GL_STATIC_DRAW);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)0);
 
-    glGenBuffers(1, &instance_vbo);
-    glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
-
-    glBufferData(GL_ARRAY_BUFFER, sizeof(float) * 6 * amount, nullptr, GL_DYNAMIC_DRAW);
+    // instance attributes are pointed into the stream buffer at every draw
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)0);
     glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void *)0);
-
     glVertexAttribDivisor(1, 1);
     glVertexAttribDivisor(2, 1);
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    GLState::BindBuffer(GL_ARRAY_BUFFER, 0);
+    GLState::BindVertexArray(0);
+}
 
-    for (unsigned int i = 0; i < this->amount; i++)
-        this->particles.emplace_back(Particle());
-    
-    instance_data = new float[this->amount * 6];
+
+// the budget band: shrink above TargetMs, grow below kBudgetLow of it
+const float        kBudgetLow = 0.7f;
+const unsigned int kBudgetFramesDown = 3;   // frames over the target before shrinking
+const unsigned int kBudgetFramesUp = 30;    // frames under the band before growing
+const float        kBudgetShrink = 0.75f;
+const float        kBudgetGrow = 0.1f;
+const float        kBudgetMinScale = 0.05f;
+const float        kBudgetSmoothing = 0.1f; // weight of the newest frame in CostMs
+// frames to leave CostMs alone after a change, about as long as it takes to follow one
+const unsigned int kBudgetSettleFrames = (unsigned int)(1.0f / kBudgetSmoothing + 0.5f);
+
+
+ParticleBudget::ParticleBudget(float targetMs) : TargetMs(targetMs), Scale(1.0f), CostMs(0.0f), over(0), under(0), settle(0) {
 }
 
 
-void ParticleGenerator::Update(float dt, GameObject &object, unsigned int newParticles, glm::vec2 offset) {
-    // add new particles 
-    for (unsigned int i = 0; i < newParticles; ++i) {
-        int unusedParticle = this->firstUnusedParticle();
-        this->respawnParticle(this->particles[unusedParticle], object, offset);
+bool ParticleBudget::Frame(float costMs) {
+    this->CostMs += (costMs - this->CostMs) * kBudgetSmoothing;
+    // the smoothed cost still mostly reflects the old scale, judging it now would overshoot
+    if (this->settle > 0) {
+        --this->settle;
+        return false;
     }
-    // update all particles
-    for (unsigned int i = 0; i < this->amount; ++i) {
-        Particle &p = this->particles[i];
-        p.Life -= dt;   // reduce life
-        if (p.Life > 0.0f) {
-            p.Position -= p.Velocity * dt; 
-            p.Color.a -= dt * 2.5f;
-        }
+
+    this->over = this->CostMs > this->TargetMs ? this->over + 1 : 0;
+    this->under = this->CostMs < this->TargetMs * kBudgetLow ? this->under + 1 : 0;
+
+    float scale = this->Scale;
+    if (this->over >= kBudgetFramesDown)
+        scale = std::max(kBudgetMinScale, scale * kBudgetShrink);
+    else if (this->under >= kBudgetFramesUp)
+        scale = std::min(1.0f, scale + kBudgetGrow);
+    if (scale == this->Scale)
+        return false;
+
+    this->Scale = scale;
+    this->over = this->under = 0;
+    this->settle = kBudgetSettleFrames;
+    return true;
+}
+
+
+ParticleSystem::ParticleSystem() : emitters(kMaxEmitters) {
+    for (emitterSlot &slot : this->emitters)
+        slot.Used = slot.Spawning = false;
+}
+
+
+unsigned int ParticleSystem::AddEmitter(const ParticleEmitter &emitter) {
+    for (unsigned int i = 0; i < kMaxEmitters; ++i) {
+        emitterSlot &slot = this->emitters[i];
+        if (slot.Used)
+            continue;
+        slot.Emitter = emitter;
+        slot.Elapsed = slot.Owed = 0.0f;
+        slot.Anchor = slot.AnchorVelocity = glm::vec2(0.0f);
+        slot.Live = 0;
+        slot.Spawning = slot.Used = true;
+        return i;
     }
+    return kNoEmitter;
 }
 
 
-unsigned int lastUsedParticle = 0;
+void ParticleSystem::RemoveEmitter(unsigned int emitter) {
+    if (emitter < kMaxEmitters)
+        this->emitters[emitter].Spawning = false;
+}
 
-unsigned int ParticleGenerator::firstUnusedParticle() {
-    // first search from last used particle, this will usually return almost instantly
-    for (unsigned int i = lastUsedParticle; i < this->amount; ++i){
-        if (this->particles[i].Life <= 0.0f){
-            lastUsedParticle = i;
-            return i;
+
+void ParticleSystem::MoveEmitter(unsigned int emitter, glm::vec2 position, glm::vec2 velocity) {
+    if (emitter >= kMaxEmitters)
+        return;
+    this->emitters[emitter].Anchor = position;
+    this->emitters[emitter].AnchorVelocity = velocity;
+}
+
+
+void ParticleSystem::Clear() {
+    for (emitterSlot &slot : this->emitters)
+        slot.Used = slot.Spawning = false;
+}
+
+
+void ParticleSystem::runEmitters(float dt) {
+    float scale = this->Budget.Scale;
+    for (unsigned int i = 0; i < kMaxEmitters; ++i) {
+        emitterSlot &slot = this->emitters[i];
+        if (!slot.Spawning)
+            continue;
+        const ParticleEmitter &emitter = slot.Emitter;
+        unsigned int count;
+        if (emitter.Mode == EMITTER_BURST) {
+            count = (unsigned int)(emitter.Count * scale + 0.5f);
+            slot.Spawning = false;
         }
-    }
-    // otherwise, do a linear search
-    for (unsigned int i = 0; i < lastUsedParticle; ++i){
-        if (this->particles[i].Life <= 0.0f){
-            lastUsedParticle = i;
-            return i;
+        else {
+            slot.Owed += emitter.Rate * scale * dt;
+            count = (unsigned int)slot.Owed;
+            slot.Owed -= count;
+            slot.Elapsed += dt;
+            if (emitter.Duration > 0.0f && slot.Elapsed >= emitter.Duration)
+                slot.Spawning = false;
+        }
+
+        // as far as the emitter's budget and the live limit allow
+        count = std::min(count, emitter.Budget > slot.Live ? emitter.Budget - slot.Live : 0u);
+        count = std::min(count, this->Limit() - std::min(this->Live(), this->Limit()));
+        if (count == 0)
+            continue;
+        glm::vec2 position = emitter.Position;
+        glm::vec2 velocity = emitter.Velocity;
+        if (emitter.Mode == EMITTER_ATTACHED) {
+            position += slot.Anchor;
+            velocity += slot.AnchorVelocity * emitter.Inherit;
         }
+        slot.Live += this->spawn(i, position, velocity, count);
     }
-    // all particles are taken, override the first one
-    lastUsedParticle = 0;
-    return 0;
 }
 
 
-void ParticleGenerator::respawnParticle(Particle &particle, GameObject &object, glm::vec2 offset) {
-    float random = ((rand() % 100) - 50) / 10.0f;
-    float rColor = 0.5f + ((rand() % 100) / 100.0f);
-    particle.Position = object.Position + random + offset;
-    particle.Color = glm::vec4(rColor, rColor, rColor, 1.0f);
-    particle.Life = 0.8f;
-    particle.Velocity = object.Velocity * 0.1f;
+void ParticleSystem::releaseEmitters() {
+    for (emitterSlot &slot : this->emitters)
+        if (!slot.Spawning && slot.Live == 0)
+            slot.Used = false;
+}
+
+
+void ParticleGenerator::Clear() {
+    this->particles.Live = 0;
+    ParticleSystem::Clear();
+}
+
+
+void ParticleGenerator::Update(float dt) {
+    auto start = std::chrono::steady_clock::now();
+    this->runEmitters(dt);
+    // the compaction counts what each emitter still has out on its way
+    std::fill(this->emitterLive.begin(), this->emitterLive.end(), 0u);
+    this->particles.Update(dt, this->pool, this->emitterLive.data());
+    for (unsigned int i = 0; i < kMaxEmitters; ++i)
+        this->emitters[i].Live = this->emitterLive[i];
+    this->releaseEmitters();
+
+    this->frameCost += std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+}
+
+
+unsigned int ParticleGenerator::spawn(unsigned int slot, glm::vec2 position, glm::vec2 velocity, unsigned int count) {
+    uint64_t seed = (uint64_t)this->random.Next() << 32 | this->random.Next();
+    return this->particles.Emit(this->emitters[slot].Emitter, (unsigned short)slot, position, velocity, count, seed, this->pool);
 }
 
 
 void ParticleGenerator::Draw() {
-    // use additive blending to give it a 'glow' effect
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+    // the GPU time of an earlier frame's draw, whichever has finished
+    this->timer.Poll();
+    this->draw();
+
+    // a frame ends with its draw: hand its cost to the budget and apply any new scale
+    if (this->Budget.Frame((this->frameCost + this->timer.Seconds) * 1000.0f))
+        this->particles.Limit = std::max(1u, (unsigned int)(this->amount * this->Budget.Scale));
+    this->frameCost = 0.0f;
+}
+
+
+void ParticleGenerator::draw() {
+    // use additive blending to give it a 'glow' effect, whoever draws next sets their own
+    GLState::BlendFunc(GL_SRC_ALPHA, GL_ONE);
     this->shader.Use();
 
 //     for (Particle &particle : this->particles) {
@@ -117,34 +370,44 @@ void ParticleGenerator::Draw() {
 //             this->shader.SetVector2f("offset", particle.Position);
 //             this->shader.SetVector4f("color", particle.Color);
 //             this->texture.Bind();
-//             glBindVertexArray(this->VAO);
+//             GLState::BindVertexArray(this->VAO);
 
 //             glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 
-//             glBindVertexArray(0);
+//             GLState::BindVertexArray(0);
 //         }
 //     }
 
-    this->texture.Bind();
-    glBindVertexArray(this->VAO);
-
-    unsigned int cnt = 0;
-    for (Particle &particle : this->particles) {
-        if (particle.Life > 0.0f) {
-            instance_data[cnt++] = particle.Position.x;
-            instance_data[cnt++] = particle.Position.y;
-            instance_data[cnt++] = particle.Color.r;
-            instance_data[cnt++] = particle.Color.g;
-            instance_data[cnt++] = particle.Color.b;
-            instance_data[cnt++] = particle.Color.a;
-        }
+    unsigned int count = this->particles.Live;
+    if (count == 0) {
+        // nothing drawn, nothing for the GPU to charge this frame
+        this->timer.Seconds = 0.0f;
+        return;
     }
+    this->texture.Bind();
 
-    glBindBuffer(GL_ARRAY_BUFFER, this->instance_vbo);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(float) * cnt, instance_data);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, cnt / 6);
-    glBindVertexArray(0);
+    // live particles are packed at the front, so this is one straight pass
+    // written directly into the mapped buffer
+    size_t offset;
+    ParticleInstance *data = (ParticleInstance *)this->stream.Map(sizeof(ParticleInstance) * count, sizeof(ParticleInstance), offset);
+    // only the fill counts, mapping may wait on unrelated rendering still in flight
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < count; ++i) {
+        data[i].X = this->particles.X[i];
+        data[i].Y = this->particles.Y[i];
+        data[i].Color[0] = packUnorm8(this->particles.R[i]);
+        data[i].Color[1] = packUnorm8(this->particles.G[i]);
+        data[i].Color[2] = packUnorm8(this->particles.B[i]);
+        data[i].Color[3] = packUnorm8(this->particles.A[i]);
+    }
+    this->frameCost += std::chrono::duration<float>(std::chrono::steady_clock::now() - start).count();
+    this->stream.Unmap();
 
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    GLState::BindVertexArray(this->VAO);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(ParticleInstance), (void *)(offset + offsetof(ParticleInstance, X)));
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ParticleInstance), (void *)(offset + offsetof(ParticleInstance, Color)));
+    this->timer.Begin();
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+    this->timer.End();
+    this->stream.EndFrame();
 }
@@ -7,42 +7,226 @@
 #include "shader.h"
 #include "texture.h"
 #include "object.h"
+#include "gpu_timer.h"
+#include "random.h"
+#include "stream_buffer.h"
+#include "thread_pool.h"
 
 
-class Particle {
+// Particles are stored as one array per field so the update kernel can
+// process kParticleLanes of them per instruction. Capacity is padded to a
+// multiple of kParticleLanes. Live particles are kept packed in [0, Live):
+// spawning appends, and a particle that dies is replaced by the last live one.
+const unsigned int kParticleLanes = 8;
+
+// particles per job when the update and spawning are split across a thread
+// pool; a multiple of kParticleLanes. Spawning draws its random numbers from
+// one stream per chunk, so the results never depend on the thread count
+const unsigned int kParticleGrain = 16384;
+
+// what ParticleStore::Spawn returns when there is no slot at all
+const unsigned int kNoParticle = ~0u;
+
+
+// Emitters only describe where and how fast particles appear; every emitter
+// spawns into the generator's one pool, and all of them are drawn together
+// with a single instanced draw.
+enum EmitterMode {
+    EMITTER_BURST,          // Count particles at once, then done
+    EMITTER_CONTINUOUS,     // Rate particles a second at Position
+    EMITTER_ATTACHED        // Rate particles a second, following the anchor given to MoveEmitter
+};
+
+struct ParticleEmitter {
+    EmitterMode       Mode;
+    glm::vec2         Position;     // spawn point, an offset from the anchor when attached
+    glm::vec2         Velocity;     // base particle velocity
+    float             Inherit;      // attached only: share of the anchor's velocity added to Velocity
+    float             Spread;       // spawn points jitter by up to this many pixels
+    float             Speed;        // extra speed in a random direction, up to this
+    glm::vec3         Color;        // scaled by a random shade in [0.5, 1.5)
+    float             Life;         // seconds each particle lives
+    float             Rate;         // continuous and attached: particles per second
+    unsigned int      Count;        // burst: particles spawned at once
+    float             Duration;     // continuous and attached: seconds to run, 0 until removed
+    unsigned int      Budget;       // most of its particles alive at once, spawns past it are dropped
+
+    ParticleEmitter(EmitterMode mode = EMITTER_BURST)
+        : Mode(mode), Position(0.0f), Velocity(0.0f), Inherit(0.0f), Spread(0.0f), Speed(0.0f),
+          Color(1.0f), Life(1.0f), Rate(0.0f), Count(0), Duration(0.0f), Budget(64) { }
+};
+
+
+class ParticleStore {
 public:
-    glm::vec2 Position, Velocity;
-    glm::vec4 Color;
-    float Life;
+    std::vector<float> X, Y;            // position
+    std::vector<float> VX, VY;          // velocity
+    std::vector<float> R, G, B, A;      // color
+    std::vector<float> Life;            // seconds left
+    std::vector<unsigned short> Owner;  // emitter that spawned it, not touched by the kernel
+
+    unsigned int Live;      // particles alive, packed at the front
+    unsigned int Limit;     // most particles alive at once, at most Capacity
+
+    explicit ParticleStore(unsigned int capacity = 0);
+
+    unsigned int Capacity() const { return (unsigned int)this->Life.size(); }
+
+    // O(1): the slot for a new particle, the caller fills in every field.
+    // When Limit particles are alive the first one is replaced; with a Limit
+    // of 0 there is none to replace and it returns kNoParticle
+    unsigned int Spawn() { return this->Live < this->Limit ? this->Live++ : this->Limit > 0 ? 0 : kNoParticle; }
+
+    // appends up to count particles from emitter, as many as fit under Limit, at position
+    // moving at velocity (the emitter's Target is not read). Particle k of the batch draws
+    // from Random(seed, k / kParticleGrain). Returns the number spawned
+    unsigned int Emit(const ParticleEmitter &emitter, unsigned short owner, glm::vec2 position, glm::vec2 velocity,
+                      unsigned int count, uint64_t seed, ThreadPool *pool = nullptr);
+
+    // ages the live particles by dt, moves and fades the survivors and packs out the dead.
+    // The kernel runs in kParticleGrain chunks on pool when given; compaction stays serial.
+    // ownerLive, when given, receives the survivors per Owner (zeroed by the caller)
+    void Update(float dt, ThreadPool *pool = nullptr, unsigned int *ownerLive = nullptr);
+
+    // the kernel: ages every slot in [begin, end) by dt and moves and fades the ones still alive.
+    // begin and end must be multiples of kParticleLanes
+    void Update(float dt, unsigned int begin, unsigned int end);
+    // swap-removes every particle in [0, Live) whose life ran out, counting
+    // the survivors per Owner into ownerLive when given
+    void Compact(unsigned int *ownerLive = nullptr);
+
+private:
+    void move(unsigned int from, unsigned int to);
+};
+
+
+// per-particle data read by particle.vs, 12 bytes per instance
+struct ParticleInstance {
+    float         X, Y;         // position
+    unsigned char Color[4];     // rgba, read back as normalized floats
+};
+
 
+// Keeps the particle system inside a per-frame time budget. Fed the measured
+// update + draw time once a frame, it shrinks Scale quickly while the smoothed
+// cost is over TargetMs and grows it back slowly once it has stayed well under.
+// After every change it waits for the smoothed cost to catch up before judging
+// again; that and the gap between the two thresholds are the hysteresis that
+// keeps it from oscillating around the target.
+class ParticleBudget {
 public:
-    Particle()
-        : Position(0.0f), Velocity(0.0f), Color(1.0f), Life(0.0f) {}
+    float TargetMs;     // update + draw time allowed per frame
+    float Scale;        // share of full capacity and spawn rate in use, in (0, 1]
+    float CostMs;       // smoothed measured cost per frame
+
+    explicit ParticleBudget(float targetMs = 2.0f);
+
+    // one frame's measured cost; true when Scale changed
+    bool Frame(float costMs);
+
+private:
+    unsigned int over, under;   // consecutive frames above and below the band
+    unsigned int settle;        // frames left before the last change is judged
 };
 
 
-class ParticleGenerator {
+const unsigned int kMaxEmitters = 64;
+const unsigned int kNoEmitter = ~0u;
+
+
+// What a game needs from a particle backend. The emitter slots and how many
+// particles each emitter owes per update are kept here; a backend only
+// spawns, simulates and draws them.
+class ParticleSystem {
 public:
-    ParticleGenerator(Shader shader, Texture2D texture, unsigned int amount);
-    ~ParticleGenerator();
+    // frame cost control, Scale is applied to the live limit and every emitter's spawns
+    ParticleBudget Budget;
+
+    ParticleSystem();
+    virtual ~ParticleSystem() { }
+
+    ParticleSystem(const ParticleSystem &) = delete;
+    ParticleSystem &operator=(const ParticleSystem &) = delete;
+
+    // kNoEmitter when all kMaxEmitters slots are taken. Bursts free their
+    // slot by themselves once their particles are gone
+    unsigned int AddEmitter(const ParticleEmitter &emitter);
+    // stops spawning, particles already out live on
+    void RemoveEmitter(unsigned int emitter);
+    // where an attached emitter's anchor is now and how fast it moves; the owner
+    // pushes this every update instead of the emitter holding on to the object
+    void MoveEmitter(unsigned int emitter, glm::vec2 position, glm::vec2 velocity);
+    // kills every particle and emitter
+    virtual void Clear();
+
+    virtual unsigned int Live() const = 0;
+    virtual unsigned int Limit() const = 0;
+
+    // pool to split large updates and bursts across, null to run them on the calling thread
+    virtual void SetThreadPool(ThreadPool *pool) { }
+
+    // spawns what the emitters owe for dt, then advances every particle
+    virtual void Update(float dt) = 0;
+    virtual void Draw() = 0;
 
-    void Update(float dt, GameObject &object, unsigned int newParticles, glm::vec2 offset = glm::vec2(0.0f, 0.0f));
-    void Draw();
+protected:
+    struct emitterSlot {
+        ParticleEmitter Emitter;
+        float           Elapsed;    // seconds since it was added
+        float           Owed;       // fractional particles carried to the next update
+        glm::vec2       Anchor;     // attached only: last position and velocity from MoveEmitter
+        glm::vec2       AnchorVelocity;
+        unsigned int    Live;       // its particles alive, kept up to date by the backend
+        bool            Spawning;   // false once done or removed
+        bool            Used;       // false while the slot is free
+    };
+
+    std::vector<emitterSlot> emitters;
+
+    // hands what every spawning emitter owes for dt to spawn, within its budget and Limit
+    void runEmitters(float dt);
+    // frees the slots of emitters that stopped and have nothing left alive
+    void releaseEmitters();
+    // starts count particles of emitter slot at position, moving at velocity; returns how many it started
+    virtual unsigned int spawn(unsigned int slot, glm::vec2 position, glm::vec2 velocity, unsigned int count) = 0;
+};
+
+
+// The CPU backend: particles live in a ParticleStore, are advanced by its
+// SIMD kernel and streamed to the GPU for one instanced draw per frame.
+class ParticleGenerator : public ParticleSystem {
+public:
+    ParticleGenerator(Shader shader, Texture2D texture, unsigned int amount, Random random = Random());
+
+    void Clear() override;
+
+    unsigned int Live() const override { return this->particles.Live; }
+    unsigned int Limit() const override { return this->particles.Limit; }
+    // the pool itself, for tools that place particles by hand rather than through emitters
+    ParticleStore &Particles() { return this->particles; }
+
+    void SetThreadPool(ThreadPool *pool) override { this->pool = pool; }
+
+    void Update(float dt) override;
+    void Draw() override;
 
 private:
-    std::vector<Particle> particles;
+    ParticleStore particles;
     unsigned int amount;
+    Random random;
+    std::vector<unsigned int> emitterLive;  // survivors per emitter, counted by the compaction
+    ThreadPool *pool;
+    float frameCost;        // CPU seconds spent in Update and Draw since the last Draw
+    GPUTimer timer;         // the instanced draw
 
     Shader shader;
     Texture2D texture;
     unsigned int VAO;
-
-    float* instance_data;
-    unsigned int instance_vbo;
+    StreamBuffer stream;    // ParticleInstance per live particle
 
     void init();
-    unsigned int firstUnusedParticle();
-    void respawnParticle(Particle &particle, GameObject &object, glm::vec2 offset = glm::vec2(0.0f, 0.0f));
+    unsigned int spawn(unsigned int slot, glm::vec2 position, glm::vec2 velocity, unsigned int count) override;
+    void draw();
 };
 
 #endif
@@ -2,19 +2,20 @@
 #include <glad/glad.h>
 
 #include "post_process.h"
+#include "gl_state.h"
 
 #define OPTIMIZE
 
 
 PostProcessor::PostProcessor(Shader shader, unsigned int width, unsigned int height)
-        : PostProcessor_Shader(shader), Texture(), Width(width), Height(height), confuse(false), chaos(false), shake(false) {
+        : PostProcessor_Shader(shader), Texture(), Width(width), Height(height), confuse(false), chaos(false), shake(false), direct(false) {
 
     glGenFramebuffers(1, &this->MSFBO);
     glGenFramebuffers(1, &this->FBO);
     glGenRenderbuffers(1, &this->RBO);
 
     // initialize renderbuffer storage with a multisampled color buffer
-    glBindFramebuffer(GL_FRAMEBUFFER, this->MSFBO);
+    GLState::BindFramebuffer(GL_FRAMEBUFFER, this->MSFBO);
     glBindRenderbuffer(GL_RENDERBUFFER, this->RBO);
     // allocate storage for render buffer object
     glRenderbufferStorageMultisample(GL_RENDERBUFFER, 4, GL_RGB, width, height);
@@ -25,14 +26,14 @@ PostProcessor::PostProcessor(Shader shader, unsigned int width, unsigned int hei
     }
 
     // initialize the FBO/texture to blit multisampled color-buffer to; used for shader operations (for postprocessing effects)
-    glBindFramebuffer(GL_FRAMEBUFFER, this->FBO);
+    GLState::BindFramebuffer(GL_FRAMEBUFFER, this->FBO);
     this->Texture.Generate(width, height, NULL);
     // attach texture to framebuffer as its color attachment
     glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->Texture.ID, 0);
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
         std::cout << "ERROR::POSTPROCESSOR: Failed to initialize MSFBO" << std::endl;
     }
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
 
     // initialize render data and uniforms
     this->initRenderData();
@@ -49,19 +50,25 @@ PostProcessor::PostProcessor(Shader shader, unsigned int width, unsigned int hei
         {  0.0f,   -offset  },  // bottom-center
         {  offset, -offset  }   // bottom-right    
     };
-    glUniform2fv(glGetUniformLocation(this->PostProcessor_Shader.ID, "offsets"), 9, (float*)offsets);
+    glUniform2fv(this->PostProcessor_Shader.Location("offsets"), 9, (float*)offsets);
     int edge_kernel[9] = {
         -1, -1, -1,
         -1,  8, -1,
         -1, -1, -1
     };
-    glUniform1iv(glGetUniformLocation(this->PostProcessor_Shader.ID, "edge_kernel"), 9, edge_kernel);
+    glUniform1iv(this->PostProcessor_Shader.Location("edge_kernel"), 9, edge_kernel);
     float blur_kernel[9] = {
         1.0f / 16.0f, 2.0f / 16.0f, 1.0f / 16.0f,
         2.0f / 16.0f, 4.0f / 16.0f, 2.0f / 16.0f,
         1.0f / 16.0f, 2.0f / 16.0f, 1.0f / 16.0f
     };
-    glUniform1fv(glGetUniformLocation(this->PostProcessor_Shader.ID, "blur_kernel"), 9, blur_kernel);
+    glUniform1fv(this->PostProcessor_Shader.Location("blur_kernel"), 9, blur_kernel);
+
+    // per-frame uniforms
+    this->timeLocation = this->PostProcessor_Shader.Location("time");
+    this->confuseLocation = this->PostProcessor_Shader.Location("confuse");
+    this->chaosLocation = this->PostProcessor_Shader.Location("chaos");
+    this->shakeLocation = this->PostProcessor_Shader.Location("shake");
 }
 
 
@@ -92,51 +99,58 @@ void PostProcessor::initRenderData() {
     glGenVertexArrays(1, &this->VAO);
     glGenBuffers(1, &VBO);
 
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    GLState::BindBuffer(GL_ARRAY_BUFFER, VBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
-    glBindVertexArray(this->VAO);
+    GLState::BindVertexArray(this->VAO);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)0);
     
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+    GLState::BindBuffer(GL_ARRAY_BUFFER, 0);
+    GLState::BindVertexArray(0);
 }
 
 
 void PostProcessor::BeginRender() {
-    glBindFramebuffer(GL_FRAMEBUFFER, this->MSFBO);
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
+    // decided once per frame, so an effect switching on or off takes effect on the next frame whole
+    this->direct = !this->Active();
+    GLState::BindFramebuffer(GL_FRAMEBUFFER, this->direct ? 0 : this->MSFBO);
+    // the default framebuffer was already cleared for the frame
+    if (!this->direct) {
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
 }
 
 void PostProcessor::EndRender() {
+    if (this->direct)
+        return;
     // now resolve multisampled color-buffer into intermediate FBO to store to texture
-    glBindFramebuffer(GL_READ_FRAMEBUFFER, this->MSFBO);
-    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, this->FBO);
+    GLState::BindFramebuffer(GL_READ_FRAMEBUFFER, this->MSFBO);
+    GLState::BindFramebuffer(GL_DRAW_FRAMEBUFFER, this->FBO);
     glBlitFramebuffer(0, 0, this->Width, this->Height, 0, 0, this->Width, this->Height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
     // binds both READ and WRITE framebuffer to default framebuffer
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    GLState::BindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 
 void PostProcessor::Render(float time) {
+    if (this->direct)
+        return;
     this->PostProcessor_Shader.Use();
-    this->PostProcessor_Shader.SetFloat("time", time);
-    this->PostProcessor_Shader.SetInteger("confuse", this->confuse);
-    this->PostProcessor_Shader.SetInteger("chaos", this->chaos);
-    this->PostProcessor_Shader.SetInteger("shake", this->shake);
+    this->PostProcessor_Shader.SetFloatAt(this->timeLocation, time);
+    this->PostProcessor_Shader.SetIntegerAt(this->confuseLocation, this->confuse);
+    this->PostProcessor_Shader.SetIntegerAt(this->chaosLocation, this->chaos);
+    this->PostProcessor_Shader.SetIntegerAt(this->shakeLocation, this->shake);
 
     // render textured quad
-    glActiveTexture(GL_TEXTURE0);
+    GLState::ActiveTexture(GL_TEXTURE0);
     this->Texture.Bind();	
-    glBindVertexArray(this->VAO);
+    GLState::BindVertexArray(this->VAO);
 
 #ifndef OPTIMIZE
     glDrawArrays(GL_TRIANGLES, 0, 6);
 #else
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 #endif
-
-    glBindVertexArray(0);
 }
@@ -17,6 +17,12 @@ public:
     bool confuse, chaos, shake;
 
     PostProcessor(Shader shader, unsigned int width, unsigned int height);
+
+    // true when any effect is on; without one the scene is drawn straight to
+    // the default framebuffer and EndRender and Render do nothing
+    bool Active() const { return this->confuse || this->chaos || this->shake; }
+
+    // the caller clears the default framebuffer, only the offscreen one is cleared here
     void BeginRender();
     void EndRender();
     void Render(float time);
@@ -25,6 +31,8 @@ private:
     unsigned int MSFBO, FBO;    // MSFBO = Multisampled FBO. FBO is regular, used for blitting MS color-buffer to texture
     unsigned int RBO;           // RBO is used for multisampled color buffer
     unsigned int VAO;
+    int timeLocation, confuseLocation, chaosLocation, shakeLocation;
+    bool direct;                // this frame went straight to the default framebuffer
 
     void initRenderData();
 };
@@ -0,0 +1,60 @@
+#include "power_up.h"
+
+
+PowerUpPool::PowerUpPool(unsigned int capacity)
+    : slots(capacity), generations(capacity, 0), live(capacity, 0), end(0) {
+    this->freeList.reserve(capacity);
+    this->Clear();
+}
+
+
+PowerUpHandle PowerUpPool::Spawn(PowerUpType type, glm::vec2 position) {
+    PowerUpHandle handle = { kInvalid, 0 };
+    if (this->freeList.empty())
+        return handle;
+
+    unsigned int i = this->freeList.back();
+    this->freeList.pop_back();
+    if (i >= this->end)
+        this->end = i + 1;
+
+    PowerUp &powerUp = this->slots[i];
+    powerUp = PowerUp();
+    powerUp.Type = type;
+    powerUp.Position = powerUp.PrevPosition = position;
+    powerUp.Duration = PowerUpKinds[type].Duration;
+    this->live[i] = 1;
+
+    handle.Index = i;
+    handle.Generation = this->generations[i];
+    return handle;
+}
+
+
+void PowerUpPool::Release(unsigned int index) {
+    if (!this->live[index])
+        return;
+    this->live[index] = 0;
+    ++this->generations[index];
+    this->freeList.push_back(index);
+}
+
+
+void PowerUpPool::Clear() {
+    for (unsigned int i = 0; i < this->end; ++i)
+        if (this->live[i]) {
+            this->live[i] = 0;
+            ++this->generations[i];
+        }
+    this->freeList.clear();
+    for (unsigned int i = this->Capacity(); i > 0; --i)
+        this->freeList.push_back(i - 1);
+    this->end = 0;
+}
+
+
+PowerUp *PowerUpPool::Get(PowerUpHandle handle) {
+    if (handle.Index >= this->Capacity() || !this->live[handle.Index] || this->generations[handle.Index] != handle.Generation)
+        return nullptr;
+    return &this->slots[handle.Index];
+}
@@ -1,24 +1,102 @@
 #ifndef POWER_UP
 #define POWER_UP
 
-#include <string>
+#include <vector>
+
 #include <glm/glm.hpp>
 
-#include "object.h"
+class Game;
 
 
 const glm::vec2 VELOCITY(0.0f, 150.0f);
 const glm::vec2 POWERUP_SIZE(60.0f, 20.0f);
 
 
-class PowerUp : public GameObject {
+enum PowerUpType {
+    POWERUP_SPEED,
+    POWERUP_STICKY,
+    POWERUP_PASS_THROUGH,
+    POWERUP_PAD_SIZE_INCREASE,
+    POWERUP_CONFUSE,
+    POWERUP_CHAOS,
+    POWERUP_TYPE_COUNT
+};
+
+// everything that differs between power-up kinds, indexed by PowerUpType
+struct PowerUpKind {
+    const char *Texture;
+    glm::vec3   Color;
+    float       Duration;   // seconds the effect lasts, 0 for instant effects
+    unsigned int Chance;    // one in Chance bricks spawns this kind
+    void      (*Activate)(Game &game);
+    void      (*Deactivate)(Game &game);  // run when the last active one of this kind expires, may be null
+};
+
+extern const PowerUpKind PowerUpKinds[POWERUP_TYPE_COUNT];
+
+
+// Size, velocity, texture and color are the same for every power-up of a
+// kind, so only the state that changes per instance is stored.
+class PowerUp {
 public:
-    std::string Type;
+    glm::vec2   Position;
+    glm::vec2   PrevPosition;   // position at the start of the current tick, for render interpolation
+    PowerUpType Type;
     float       Duration;	
     bool        Activated;
+    bool        Destroyed;
+
+    PowerUp() : Position(0.0f), PrevPosition(0.0f), Type(POWERUP_SPEED), Duration(0.0f), Activated(false), Destroyed(false) {}
+};
+
+
+// Stays valid across other spawns and releases; a released slot bumps its
+// generation so stale handles stop resolving.
+struct PowerUpHandle {
+    unsigned int Index;
+    unsigned int Generation;
+};
+
+const unsigned int kPowerUpCapacity = 128;
+
+
+// Fixed-capacity power-up storage. All memory is reserved up front, spawning
+// pops a free slot and releasing pushes it back, so play never allocates.
+class PowerUpPool {
+public:
+    static const unsigned int kInvalid = ~0u;
+
+    explicit PowerUpPool(unsigned int capacity = kPowerUpCapacity);
+
+    unsigned int Capacity() const { return (unsigned int)this->slots.size(); }
+    unsigned int Count() const    { return this->Capacity() - (unsigned int)this->freeList.size(); }
+
+    // handle Index is kInvalid when the pool is full and the spawn was dropped
+    PowerUpHandle Spawn(PowerUpType type, glm::vec2 position);
+    void Release(unsigned int index);
+    void Clear();
+
+    // null if the handle's slot has since been released
+    PowerUp *Get(PowerUpHandle handle);
+
+    // visits live power-ups in slot order
+    template <typename Fn> void ForEach(Fn fn) {
+        for (unsigned int i = 0; i < this->end; ++i)
+            if (this->live[i])
+                fn(i, this->slots[i]);
+    }
+    template <typename Fn> void ForEach(Fn fn) const {
+        for (unsigned int i = 0; i < this->end; ++i)
+            if (this->live[i])
+                fn(i, this->slots[i]);
+    }
 
-    PowerUp(std::string type, glm::vec3 color, float duration, glm::vec2 position, Texture2D texture) 
-        : GameObject(position, POWERUP_SIZE, texture, color, VELOCITY), Type(type), Duration(duration), Activated() {}
+private:
+    std::vector<PowerUp>        slots;
+    std::vector<unsigned int>   generations;
+    std::vector<unsigned char>  live;
+    std::vector<unsigned int>   freeList;   // popped from the back, lowest index first
+    unsigned int                end;        // one past the highest slot ever used
 };
 
 #endif
@@ -0,0 +1,43 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+
+
+// PCG32 generator (pcg-random.org): 64-bit state, 32-bit output. The same
+// seed with different stream ids gives independent sequences, so one seed
+// can feed separate gameplay and cosmetic generators. Cheap to copy and
+// owned by value, so instances on different threads never share state.
+class Random {
+public:
+    Random(uint64_t seed = 0, uint64_t stream = 0) { this->Seed(seed, stream); }
+
+    void Seed(uint64_t seed, uint64_t stream) {
+        this->state = 0;
+        this->increment = (stream << 1) | 1;
+        this->Next();
+        this->state += seed;
+        this->Next();
+    }
+
+    uint32_t Next() {
+        uint64_t old = this->state;
+        this->state = old * 6364136223846793005ULL + this->increment;
+        uint32_t xorshifted = (uint32_t)(((old >> 18) ^ old) >> 27);
+        uint32_t rot = (uint32_t)(old >> 59);
+        return (xorshifted >> rot) | (xorshifted << ((0u - rot) & 31));
+    }
+
+    // uniform integer in [0, bound)
+    uint32_t Below(uint32_t bound) { return (uint32_t)(((uint64_t)this->Next() * bound) >> 32); }
+
+    // uniform float in [0, 1)
+    float    Float() { return (this->Next() >> 8) * (1.0f / 16777216.0f); }
+
+    uint64_t State() const { return this->state; }
+
+private:
+    uint64_t state, increment;
+};
+
+#endif
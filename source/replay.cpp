@@ -0,0 +1,161 @@
+#include <fstream>
+#include <string>
+#include <iostream>
+
+#include "replay.h"
+
+const char     kReplayMagic[4] = { 'B', 'R', 'P', 'L' };
+const uint8_t  kReplayVersion = 1;
+
+
+void Replay::RecordKey(const Game &game, int key, bool pressed) {
+    if (key < 0 || key >= (int)KEY_COUNT)
+        return;
+    // input lands in Keys[] between ticks, so it first affects the next Step
+    this->Events.push_back({ game.Ticks, (uint16_t)key, pressed });
+}
+
+
+void Replay::AfterStep(const Game &game) {
+    this->Ticks = game.Ticks;
+    if (this->ChecksumInterval != 0 && game.Ticks % this->ChecksumInterval == 0)
+        this->Checksums.push_back(game.Checksum());
+}
+
+
+// events are stored as LEB128 varints: tick delta, then key << 1 | pressed
+static void writeVarint(std::ofstream &out, uint64_t value) {
+    do {
+        uint8_t byte = value & 0x7F;
+        value >>= 7;
+        if (value)
+            byte |= 0x80;
+        out.put((char)byte);
+    } while (value);
+}
+
+static bool readVarint(std::ifstream &in, uint64_t &value) {
+    value = 0;
+    for (unsigned int shift = 0; shift < 64; shift += 7) {
+        int byte = in.get();
+        if (byte == EOF)
+            return false;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+template <typename T>
+static void writeRaw(std::ofstream &out, const T &value) {
+    out.write(reinterpret_cast<const char *>(&value), sizeof(T));
+}
+
+template <typename T>
+static bool readRaw(std::ifstream &in, T &value) {
+    return (bool)in.read(reinterpret_cast<char *>(&value), sizeof(T));
+}
+
+
+bool Replay::Save(const char *file) const {
+    std::ofstream out(file, std::ios::binary);
+    if (!out) {
+        std::cout << "ERROR::REPLAY: Failed to open " << file << " for writing" << std::endl;
+        return false;
+    }
+
+    out.write(kReplayMagic, sizeof(kReplayMagic));
+    writeRaw(out, kReplayVersion);
+    writeRaw(out, this->Seed);
+    writeRaw(out, this->TickRate);
+    writeRaw(out, this->ChecksumInterval);
+    writeVarint(out, this->Ticks);
+
+    writeVarint(out, this->Events.size());
+    uint64_t tick = 0;
+    for (const ReplayEvent &event : this->Events) {
+        writeVarint(out, event.Tick - tick);
+        writeVarint(out, ((uint64_t)event.Key << 1) | (event.Pressed ? 1 : 0));
+        tick = event.Tick;
+    }
+
+    writeVarint(out, this->Checksums.size());
+    for (uint32_t checksum : this->Checksums)
+        writeRaw(out, checksum);
+    return (bool)out;
+}
+
+
+bool Replay::Load(const char *file, double tickRate) {
+    std::ifstream in(file, std::ios::binary);
+    char magic[4];
+    uint8_t version = 0;
+    if (!in || !in.read(magic, sizeof(magic)) || !readRaw(in, version)
+            || std::string(magic, 4) != std::string(kReplayMagic, 4) || version != kReplayVersion) {
+        std::cout << "ERROR::REPLAY: " << file << " is not a replay file" << std::endl;
+        return false;
+    }
+
+    uint64_t count = 0, tick = 0;
+    bool ok = readRaw(in, this->Seed) && readRaw(in, this->TickRate)
+           && readRaw(in, this->ChecksumInterval) && readVarint(in, this->Ticks)
+           && readVarint(in, count);
+
+    this->Events.clear();
+    // a well-formed replay of a different simulation, it would play back differently
+    if (ok && this->TickRate != tickRate) {
+        std::cout << "ERROR::REPLAY: " << file << " was recorded at " << this->TickRate
+                  << " ticks per second, expected " << tickRate << std::endl;
+        return false;
+    }
+
+    bool valid = true;
+    for (uint64_t i = 0; ok && valid && i < count; ++i) {
+        uint64_t delta, code;
+        ok = readVarint(in, delta) && readVarint(in, code);
+        // Play indexes Game::Keys with the key, and event ticks only ever grow
+        valid = !ok || ((code >> 1) < KEY_COUNT && tick + delta >= tick);
+        tick += delta;
+        this->Events.push_back({ tick, (uint16_t)(code >> 1), (code & 1) != 0 });
+    }
+    if (!valid) {
+        this->Events.clear();
+        std::cout << "ERROR::REPLAY: " << file << " is not a replay file" << std::endl;
+        return false;
+    }
+
+    ok = ok && readVarint(in, count);
+    this->Checksums.clear();
+    for (uint64_t i = 0; ok && i < count; ++i) {
+        uint32_t checksum;
+        ok = readRaw(in, checksum);
+        this->Checksums.push_back(checksum);
+    }
+
+    if (!ok)
+        std::cout << "ERROR::REPLAY: " << file << " is truncated" << std::endl;
+    return ok;
+}
+
+
+bool Replay::Play(Game &game, uint64_t &divergedAt) const {
+    const float tickTime = (float)(1.0 / this->TickRate);
+    size_t event = 0;
+
+    while (game.Ticks < this->Ticks) {
+        for (; event < this->Events.size() && this->Events[event].Tick == game.Ticks; ++event)
+            game.Keys[this->Events[event].Key] = this->Events[event].Pressed;
+
+        game.Step(tickTime);
+
+        if (this->ChecksumInterval != 0 && game.Ticks % this->ChecksumInterval == 0) {
+            uint64_t index = game.Ticks / this->ChecksumInterval - 1;
+            if (index < this->Checksums.size() && this->Checksums[index] != game.Checksum()) {
+                divergedAt = game.Ticks;
+                return false;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,49 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <cstdint>
+#include <vector>
+
+#include "game.h"
+
+
+// one Keys[] transition, applied before the given tick runs
+struct ReplayEvent {
+    uint64_t Tick;
+    uint16_t Key;
+    bool     Pressed;
+};
+
+
+// A recorded session: the game seed, the tick rate it ran at, every key
+// transition, and a state checksum every ChecksumInterval ticks. Playing it
+// back re-drives Game::Step without a window and stops at the first tick
+// whose checksum differs from the recording.
+class Replay {
+public:
+    uint64_t                  Seed;
+    double                    TickRate;
+    uint32_t                  ChecksumInterval;
+    uint64_t                  Ticks;          // length of the recording
+    std::vector<ReplayEvent>  Events;
+    std::vector<uint32_t>     Checksums;      // Checksums[i] is taken after tick (i + 1) * ChecksumInterval
+
+    Replay() : Seed(0), TickRate(0.0), ChecksumInterval(0), Ticks(0) {}
+    Replay(uint64_t seed, double tickRate, uint32_t checksumInterval)
+        : Seed(seed), TickRate(tickRate), ChecksumInterval(checksumInterval), Ticks(0) {}
+
+    // recording: call RecordKey from the key callback, AfterStep after every Game::Step
+    void RecordKey(const Game &game, int key, bool pressed);
+    void AfterStep(const Game &game);
+
+    bool Save(const char *file) const;
+    // rejects files recorded at a tick rate other than tickRate, and any with
+    // key codes or event ticks a game could not have produced
+    bool Load(const char *file, double tickRate);
+
+    // runs a freshly initialized game (Ticks == 0, seeded with Seed) through the
+    // recording; returns false and sets divergedAt on the first checksum mismatch
+    bool Play(Game &game, uint64_t &divergedAt) const;
+};
+
+#endif
@@ -1,11 +1,14 @@
 #include "resource_manager.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <iostream>
 #include <sstream>
 #include <fstream>
 
 #include <glad/glad.h>
 #include "stb_image.h"
+#include "gl_state.h"
 
 
 std::map<std::string, Texture2D>    ResourceManager::Textures;
@@ -18,8 +21,22 @@ Shader ResourceManager::LoadShader(const char *vShaderFile, const char *fShaderF
 }
 
 
+Shader ResourceManager::LoadFeedbackShader(const char *vShaderFile, const std::vector<const char *> &varyings, std::string name) {
+    std::string vertexCode = readShaderFile(vShaderFile);
+
+    Shader shader;
+    shader.CompileFeedback(vertexCode.c_str(), varyings);
+    Shaders[name] = shader;
+    return shader;
+}
+
+
+// lookups never insert, so once loading is done any number of games can
+// read the maps concurrently
 Shader& ResourceManager::GetShader(std::string name) {
-    return Shaders[name];
+    static Shader missing;
+    auto iter = Shaders.find(name);
+    return iter != Shaders.end() ? iter->second : missing;
 }
 
 
@@ -30,7 +47,9 @@ Texture2D ResourceManager::LoadTexture(const char *file, bool alpha, std::string
 
 
 Texture2D& ResourceManager::GetTexture(std::string name) {
-    return Textures[name];
+    static Texture2D missing;
+    auto iter = Textures.find(name);
+    return iter != Textures.end() ? iter->second : missing;
 }
 
 
@@ -38,41 +57,22 @@ void ResourceManager::Clear() {
     for (auto iter : Shaders)
         glDeleteProgram(iter.second.ID);
 
+    // atlas sub-textures all share the atlas ID, so delete each ID once
+    std::vector<unsigned int> textureIDs;
     for (auto iter : Textures)
-        glDeleteTextures(1, &iter.second.ID);
+        textureIDs.push_back(iter.second.ID);
+    std::sort(textureIDs.begin(), textureIDs.end());
+    textureIDs.erase(std::unique(textureIDs.begin(), textureIDs.end()), textureIDs.end());
+    glDeleteTextures((GLsizei)textureIDs.size(), textureIDs.data());
+    GLState::Invalidate();
 }
 
 
 Shader ResourceManager::loadShaderFromFile(const char *vShaderFile, const char *fShaderFile, const char *gShaderFile) {
-    std::string vertexCode;
-    std::string fragmentCode;
-    std::string geometryCode;
-    try {
-        std::ifstream vertexShaderFile(vShaderFile);
-        std::ifstream fragmentShaderFile(fShaderFile);
-        std::stringstream vShaderStream, fShaderStream;
-
-        vShaderStream << vertexShaderFile.rdbuf();
-        fShaderStream << fragmentShaderFile.rdbuf();
-
-        vertexShaderFile.close();
-        fragmentShaderFile.close();
-
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
-
-        // if geometry shader path is present, also load a geometry shader
-        if (gShaderFile != nullptr) {
-            std::ifstream geometryShaderFile(gShaderFile);
-            std::stringstream gShaderStream;
-            gShaderStream << geometryShaderFile.rdbuf();
-            geometryShaderFile.close();
-            geometryCode = gShaderStream.str();
-        }
-    }
-    catch (std::exception e) {
-        std::cout << "ERROR::SHADER: Failed to read shader files" << std::endl;
-    }
+    std::string vertexCode = readShaderFile(vShaderFile);
+    std::string fragmentCode = readShaderFile(fShaderFile);
+    // if geometry shader path is present, also load a geometry shader
+    std::string geometryCode = gShaderFile != nullptr ? readShaderFile(gShaderFile) : std::string();
 
     const char *vShaderCode = vertexCode.c_str();
     const char *fShaderCode = fragmentCode.c_str();
@@ -84,6 +84,20 @@ Shader ResourceManager::loadShaderFromFile(const char *vShaderFile, const char *
 }
 
 
+std::string ResourceManager::readShaderFile(const char *file) {
+    try {
+        std::ifstream shaderFile(file);
+        std::stringstream shaderStream;
+        shaderStream << shaderFile.rdbuf();
+        return shaderStream.str();
+    }
+    catch (const std::exception &e) {
+        std::cout << "ERROR::SHADER: Failed to read shader file " << file << std::endl;
+        return std::string();
+    }
+}
+
+
 Texture2D ResourceManager::loadTextureFromFile(const char *file, bool alpha) {
     Texture2D texture;
     if (alpha) {
@@ -98,3 +112,206 @@ Texture2D ResourceManager::loadTextureFromFile(const char *file, bool alpha) {
     stbi_image_free(data);
     return texture;
 }
+
+
+// texels of edge color repeated around every atlas image so linear filtering never picks up a neighbour
+const int kAtlasPadding = 2;
+const uint32_t kAtlasCacheVersion = 1;
+
+struct AtlasRect {
+    std::string Name;
+    int X, Y, Width, Height;
+};
+
+
+static void hashAtlasBytes(uint64_t &hash, const void *data, size_t size) {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+}
+
+
+// Shelf packing: images go tallest first onto the first shelf with room, a new
+// shelf is opened below otherwise. Every power-of-two width is tried and the
+// smallest total area wins.
+static bool packAtlas(std::vector<AtlasRect> &rects, int &atlasWidth, int &atlasHeight) {
+    std::vector<size_t> order(rects.size());
+    for (size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&rects](size_t a, size_t b) {
+        return rects[a].Height != rects[b].Height ? rects[a].Height > rects[b].Height : rects[a].Width > rects[b].Width;
+    });
+
+    struct Shelf { int Y, Height, Used; };
+    long long bestArea = -1;
+    std::vector<AtlasRect> best;
+    for (int width = 256; width <= 4096; width *= 2) {
+        std::vector<AtlasRect> placed = rects;
+        std::vector<Shelf> shelves;
+        int height = 0;
+        bool fits = true;
+        for (size_t i : order) {
+            int w = placed[i].Width + 2 * kAtlasPadding;
+            int h = placed[i].Height + 2 * kAtlasPadding;
+            if (w > width) {
+                fits = false;
+                break;
+            }
+            Shelf *shelf = nullptr;
+            for (Shelf &candidate : shelves)
+                if (h <= candidate.Height && candidate.Used + w <= width) {
+                    shelf = &candidate;
+                    break;
+                }
+            if (!shelf) {
+                shelves.push_back({ height, h, 0 });
+                height += h;
+                shelf = &shelves.back();
+            }
+            placed[i].X = shelf->Used + kAtlasPadding;
+            placed[i].Y = shelf->Y + kAtlasPadding;
+            shelf->Used += w;
+        }
+        if (!fits || height > 4096)
+            continue;
+        long long area = (long long)width * height;
+        if (bestArea < 0 || area < bestArea) {
+            bestArea = area;
+            best = placed;
+            atlasWidth = width;
+            atlasHeight = height;
+        }
+    }
+    if (bestArea < 0)
+        return false;
+    rects = best;
+    return true;
+}
+
+
+static bool loadAtlasCache(const char *cacheFile, uint64_t key, std::vector<AtlasRect> &rects, int &width, int &height,
+                           std::vector<unsigned char> &pixels) {
+    std::ifstream file(cacheFile, std::ios::binary);
+    char magic[4];
+    uint32_t version = 0, count = 0;
+    uint64_t cachedKey = 0;
+    if (!file.read(magic, 4) || std::string(magic, 4) != "BRAT")
+        return false;
+    file.read((char *)&version, sizeof(version));
+    file.read((char *)&cachedKey, sizeof(cachedKey));
+    if (!file || version != kAtlasCacheVersion || cachedKey != key)
+        return false;
+
+    file.read((char *)&width, sizeof(width));
+    file.read((char *)&height, sizeof(height));
+    file.read((char *)&count, sizeof(count));
+    if (!file || width <= 0 || height <= 0 || count != rects.size())
+        return false;
+    for (AtlasRect &rect : rects) {
+        file.read((char *)&rect.X, sizeof(rect.X));
+        file.read((char *)&rect.Y, sizeof(rect.Y));
+        file.read((char *)&rect.Width, sizeof(rect.Width));
+        file.read((char *)&rect.Height, sizeof(rect.Height));
+    }
+    pixels.resize((size_t)width * height * 4);
+    file.read((char *)pixels.data(), pixels.size());
+    return (bool)file;
+}
+
+
+static void saveAtlasCache(const char *cacheFile, uint64_t key, const std::vector<AtlasRect> &rects, int width, int height,
+                           const std::vector<unsigned char> &pixels) {
+    std::ofstream file(cacheFile, std::ios::binary);
+    uint32_t count = (uint32_t)rects.size();
+    file.write("BRAT", 4);
+    file.write((const char *)&kAtlasCacheVersion, sizeof(kAtlasCacheVersion));
+    file.write((const char *)&key, sizeof(key));
+    file.write((const char *)&width, sizeof(width));
+    file.write((const char *)&height, sizeof(height));
+    file.write((const char *)&count, sizeof(count));
+    for (const AtlasRect &rect : rects) {
+        file.write((const char *)&rect.X, sizeof(rect.X));
+        file.write((const char *)&rect.Y, sizeof(rect.Y));
+        file.write((const char *)&rect.Width, sizeof(rect.Width));
+        file.write((const char *)&rect.Height, sizeof(rect.Height));
+    }
+    file.write((const char *)pixels.data(), pixels.size());
+    if (!file)
+        std::cout << "ERROR::ATLAS: Failed to write cache " << cacheFile << std::endl;
+}
+
+
+void ResourceManager::LoadAtlas(const std::vector<AtlasImage> &images, const char *cacheFile) {
+    // the cache is keyed on the raw bytes of every source image plus the packing
+    // parameters, so editing, adding or reordering an image repacks it
+    uint64_t key = 14695981039346656037ull;
+    hashAtlasBytes(key, &kAtlasPadding, sizeof(kAtlasPadding));
+    std::vector<AtlasRect> rects(images.size());
+    for (size_t i = 0; i < images.size(); ++i) {
+        rects[i].Name = images[i].Name;
+        hashAtlasBytes(key, images[i].Name.data(), images[i].Name.size() + 1);
+
+        std::ifstream file(images[i].File, std::ios::binary);
+        std::string bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (!file)
+            std::cout << "ERROR::ATLAS: Failed to read " << images[i].File << std::endl;
+        hashAtlasBytes(key, bytes.data(), bytes.size());
+    }
+
+    int width = 0, height = 0;
+    std::vector<unsigned char> pixels;
+    if (!loadAtlasCache(cacheFile, key, rects, width, height, pixels)) {
+        // decode everything as RGBA so opaque and transparent images can share the texture
+        std::vector<unsigned char *> data(images.size(), nullptr);
+        for (size_t i = 0; i < images.size(); ++i) {
+            int channels;
+            data[i] = stbi_load(images[i].File, &rects[i].Width, &rects[i].Height, &channels, 4);
+            if (!data[i])
+                rects[i].Width = rects[i].Height = 0;
+        }
+
+        if (!packAtlas(rects, width, height)) {
+            std::cout << "ERROR::ATLAS: Images do not fit into a 4096 wide atlas" << std::endl;
+            for (unsigned char *image : data)
+                stbi_image_free(image);
+            return;
+        }
+
+        // copy each image and extrude its border into the padding around it
+        pixels.assign((size_t)width * height * 4, 0);
+        for (size_t i = 0; i < images.size(); ++i) {
+            const AtlasRect &rect = rects[i];
+            if (!data[i])
+                continue;
+            for (int y = -kAtlasPadding; y < rect.Height + kAtlasPadding; ++y) {
+                int srcY = std::min(std::max(y, 0), rect.Height - 1);
+                for (int x = -kAtlasPadding; x < rect.Width + kAtlasPadding; ++x) {
+                    int srcX = std::min(std::max(x, 0), rect.Width - 1);
+                    const unsigned char *src = data[i] + ((size_t)srcY * rect.Width + srcX) * 4;
+                    unsigned char *dst = &pixels[((size_t)(rect.Y + y) * width + rect.X + x) * 4];
+                    std::copy(src, src + 4, dst);
+                }
+            }
+            stbi_image_free(data[i]);
+        }
+        saveAtlasCache(cacheFile, key, rects, width, height, pixels);
+    }
+
+    Texture2D atlas;
+    atlas.Internal_Format = GL_RGBA;
+    atlas.Image_Format = GL_RGBA;
+    atlas.Wrap_S = GL_CLAMP_TO_EDGE;
+    atlas.Wrap_T = GL_CLAMP_TO_EDGE;
+    atlas.Generate(width, height, pixels.data());
+
+    for (const AtlasRect &rect : rects) {
+        Texture2D texture = atlas;
+        texture.Width = rect.Width;
+        texture.Height = rect.Height;
+        texture.UV = glm::vec4((float)rect.X / width, (float)rect.Y / height,
+                               (float)(rect.X + rect.Width) / width, (float)(rect.Y + rect.Height) / height);
+        Textures[rect.Name] = texture;
+    }
+}
@@ -3,11 +3,19 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include "texture.h"
 #include "shader.h"
 
 
+// an image to pack into the sprite atlas and the name its Texture2D is stored under
+struct AtlasImage {
+    const char  *File;
+    std::string Name;
+};
+
+
 class ResourceManager {
 public:
     static std::map<std::string, Shader>    Shaders;
@@ -15,12 +23,19 @@ public:
 
     static Shader    LoadShader(const char *vShaderFile, const char *fShaderFile, const char *gShaderFile, std::string name);
 
+    static Shader    LoadFeedbackShader(const char *vShaderFile, const std::vector<const char *> &varyings, std::string name);
+
     static Shader&   GetShader(std::string name);
 
     static Texture2D LoadTexture(const char *file, bool alpha, std::string name);
 
     static Texture2D& GetTexture(std::string name);
 
+    // Packs the images into one RGBA texture; each name gets a Texture2D sharing
+    // its ID with the UV of its own sub-rectangle. The packed result is cached in
+    // cacheFile and reused while the images and their order are unchanged.
+    static void      LoadAtlas(const std::vector<AtlasImage> &images, const char *cacheFile);
+
     static void      Clear();
 
     ResourceManager() = delete;
@@ -28,6 +43,8 @@ public:
 private:
     static Shader    loadShaderFromFile(const char *vShaderFile, const char *fShaderFile, const char *gShaderFile = nullptr);
 
+    static std::string readShaderFile(const char *file);
+
     static Texture2D loadTextureFromFile(const char *file, bool alpha);
 };
 
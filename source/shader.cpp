@@ -5,10 +5,11 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "shader.h"
+#include "gl_state.h"
 
 
 Shader &Shader::Use() {
-    glUseProgram(this->ID);
+    GLState::UseProgram(this->ID);
     return *this;
 }
 
@@ -44,6 +45,7 @@ void Shader::Compile(const char* vertexSource, const char* fragmentSource, const
     }
     glLinkProgram(this->ID);
     checkCompileErrors(this->ID, "PROGRAM");
+    this->cacheUniforms();
 
     glDeleteShader(sVertex);
     glDeleteShader(sFragment);
@@ -53,66 +55,158 @@ void Shader::Compile(const char* vertexSource, const char* fragmentSource, const
 }
 
 
+void Shader::CompileFeedback(const char *vertexSource, const std::vector<const char *> &varyings) {
+    unsigned int sVertex = glCreateShader(GL_VERTEX_SHADER);
+    glShaderSource(sVertex, 1, &vertexSource, NULL);
+    glCompileShader(sVertex);
+    checkCompileErrors(sVertex, "VERTEX");
+
+    // the varyings have to be named before linking
+    this->ID = glCreateProgram();
+    glAttachShader(this->ID, sVertex);
+    glTransformFeedbackVaryings(this->ID, (GLsizei)varyings.size(), varyings.data(), GL_INTERLEAVED_ATTRIBS);
+    glLinkProgram(this->ID);
+    checkCompileErrors(this->ID, "PROGRAM");
+    this->cacheUniforms();
+
+    glDeleteShader(sVertex);
+}
+
+
+void Shader::cacheUniforms() {
+    this->uniforms.clear();
+
+    int count = 0, maxLength = 0;
+    glGetProgramiv(this->ID, GL_ACTIVE_UNIFORMS, &count);
+    glGetProgramiv(this->ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::vector<char> name(maxLength + 1);
+
+    for (int i = 0; i < count; ++i) {
+        int length = 0, size = 0;
+        unsigned int type = 0;
+        glGetActiveUniform(this->ID, i, maxLength + 1, &length, &size, &type, name.data());
+        int location = glGetUniformLocation(this->ID, name.data());
+        if (location < 0)
+            continue;   // lives in a uniform block
+
+        std::string uniform(name.data(), length);
+        if (uniform.size() > 3 && uniform.compare(uniform.size() - 3, 3, "[0]") == 0)
+            uniform.resize(uniform.size() - 3);
+        this->uniforms.push_back(std::make_pair(uniform, location));
+    }
+}
+
+
+int Shader::Location(const char *name) const {
+    for (const auto &uniform : this->uniforms)
+        if (uniform.first == name)
+            return uniform.second;
+    return -1;
+}
+
+
 void Shader::SetFloat(const char *name, float value, bool useShader) {
     if (useShader)
         this->Use();
-    glUniform1f(glGetUniformLocation(this->ID, name), value);
+    glUniform1f(this->Location(name), value);
 }
 
 
 void Shader::SetInteger(const char *name, int value, bool useShader) {
     if (useShader)
         this->Use();
-    glUniform1i(glGetUniformLocation(this->ID, name), value);
+    glUniform1i(this->Location(name), value);
 }
 
 
 void Shader::SetVector2f(const char *name, float x, float y, bool useShader) {
     if (useShader)
         this->Use();
-    glUniform2f(glGetUniformLocation(this->ID, name), x, y);
+    glUniform2f(this->Location(name), x, y);
 }
 
 
 void Shader::SetVector2f(const char *name, const glm::vec2 &value, bool useShader) {
     if (useShader)
         this->Use();
-    glUniform2f(glGetUniformLocation(this->ID, name), value.x, value.y);
+    glUniform2f(this->Location(name), value.x, value.y);
 }
 
 
 void Shader::SetVector3f(const char *name, float x, float y, float z, bool useShader) {
     if (useShader)
         this->Use();
-    glUniform3f(glGetUniformLocation(this->ID, name), x, y, z);
+    glUniform3f(this->Location(name), x, y, z);
 }
 
 
 void Shader::SetVector3f(const char *name, const glm::vec3 &value, bool useShader) {
     if (useShader)
         this->Use();
-    glUniform3f(glGetUniformLocation(this->ID, name), value.x, value.y, value.z);
+    glUniform3f(this->Location(name), value.x, value.y, value.z);
 }
 
 
 void Shader::SetVector4f(const char *name, float x, float y, float z, float w, bool useShader) {
     if (useShader)
         this->Use();
-    glUniform4f(glGetUniformLocation(this->ID, name), x, y, z, w);
+    glUniform4f(this->Location(name), x, y, z, w);
 }
 
 
 void Shader::SetVector4f(const char *name, const glm::vec4 &value, bool useShader) {
     if (useShader)
         this->Use();
-    glUniform4f(glGetUniformLocation(this->ID, name), value.x, value.y, value.z, value.w);
+    glUniform4f(this->Location(name), value.x, value.y, value.z, value.w);
 }
 
 
 void Shader::SetMatrix4(const char *name, const glm::mat4 &matrix, bool useShader) {
     if (useShader)
         this->Use();
-    glUniformMatrix4fv(glGetUniformLocation(this->ID, name), 1, false, glm::value_ptr(matrix));
+    glUniformMatrix4fv(this->Location(name), 1, false, glm::value_ptr(matrix));
+}
+
+
+void Shader::SetFloatAt(int location, float value, bool useShader) {
+    if (useShader)
+        this->Use();
+    glUniform1f(location, value);
+}
+
+
+void Shader::SetIntegerAt(int location, int value, bool useShader) {
+    if (useShader)
+        this->Use();
+    glUniform1i(location, value);
+}
+
+
+void Shader::SetVector2fAt(int location, const glm::vec2 &value, bool useShader) {
+    if (useShader)
+        this->Use();
+    glUniform2f(location, value.x, value.y);
+}
+
+
+void Shader::SetVector3fAt(int location, const glm::vec3 &value, bool useShader) {
+    if (useShader)
+        this->Use();
+    glUniform3f(location, value.x, value.y, value.z);
+}
+
+
+void Shader::SetVector4fAt(int location, const glm::vec4 &value, bool useShader) {
+    if (useShader)
+        this->Use();
+    glUniform4f(location, value.x, value.y, value.z, value.w);
+}
+
+
+void Shader::SetMatrix4At(int location, const glm::mat4 &matrix, bool useShader) {
+    if (useShader)
+        this->Use();
+    glUniformMatrix4fv(location, 1, false, glm::value_ptr(matrix));
 }
 
 
@@ -2,6 +2,8 @@
 #define SHADER_H
 
 #include <string>
+#include <utility>
+#include <vector>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -16,7 +18,14 @@ public:
     Shader  &Use();
 
     void    Compile(const char *vertexSource, const char *fragmentSource, const char *geometrySource = nullptr); // note: geometry source code is optional 
+    // a vertex-only program whose varyings are captured, interleaved in this order, by transform feedback
+    void    CompileFeedback(const char *vertexSource, const std::vector<const char *> &varyings);
 
+    // location of an active uniform, resolved once at link time; -1 if the program has no such uniform.
+    // arrays are found by their plain name ("offsets" for offsets[0])
+    int     Location(const char *name) const;
+
+    // by name: a lookup in the cached table, never a driver call
     void    SetFloat    (const char *name, float value, bool useShader = false);
     void    SetInteger  (const char *name, int   value, bool useShader = false);
     void    SetVector2f (const char *name, float x,     float y,   bool useShader = false);
@@ -27,7 +36,18 @@ public:
     void    SetVector4f (const char *name, const glm::vec4 &value, bool useShader = false);
     void    SetMatrix4  (const char *name, const glm::mat4 &matrix, bool useShader = false);
 
+    // by a location from Location(), for per-frame paths; named apart so a literal 0 is never ambiguous
+    void    SetFloatAt   (int location, float value, bool useShader = false);
+    void    SetIntegerAt (int location, int   value, bool useShader = false);
+    void    SetVector2fAt(int location, const glm::vec2 &value, bool useShader = false);
+    void    SetVector3fAt(int location, const glm::vec3 &value, bool useShader = false);
+    void    SetVector4fAt(int location, const glm::vec4 &value, bool useShader = false);
+    void    SetMatrix4At (int location, const glm::mat4 &matrix, bool useShader = false);
+
 private:
+    std::vector<std::pair<std::string, int>> uniforms;
+
+    void    cacheUniforms();
     void    checkCompileErrors(unsigned int object, std::string type); 
 };
 
@@ -0,0 +1,79 @@
+#version 330 core
+// one particle per vertex, written back through transform feedback
+layout (location = 0) in vec2  position;
+layout (location = 1) in vec2  velocity;
+layout (location = 2) in vec4  color;
+layout (location = 3) in float life;
+
+out vec2  outPosition;
+out vec2  outVelocity;
+out vec4  outColor;
+out float outLife;
+
+// one emitter's spawns this update
+struct SpawnRun {
+    vec4  Origin;   // spawn position xy, velocity zw
+    vec4  Color;    // rgb, life of a new particle
+    vec4  Shape;    // spread, speed
+    uvec4 Span;     // first spawn of the run within the update, count, seed
+};
+
+layout (std140) uniform Emitter {
+    uvec4    Spawn;     // first slot, spawns in total, capacity, runs
+    vec4     Timing;    // dt
+    SpawnRun Runs[64];
+};
+
+
+uint hash(uint x) {
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+// uniform in [0, 1), advancing state
+float random(inout uint state) {
+    state = hash(state);
+    return float(state >> 8) / 16777216.0;
+}
+
+
+void main() {
+    outPosition = position;
+    outVelocity = velocity;
+    outColor = color;
+    outLife = life;
+
+    // this update's spawns replace a run of slots starting at Spawn.x, wrapping at the capacity
+    uint slot = uint(gl_VertexID);
+    uint spawned = (slot + Spawn.z - Spawn.x) % Spawn.z;
+    if (spawned < Spawn.y) {
+        // runs are in spawn order, the last one starting at or before this spawn made it
+        uint run = 0u;
+        for (uint i = 1u; i < Spawn.w; ++i)
+            if (Runs[i].Span.x <= spawned)
+                run = i;
+
+        uint state = hash(slot ^ hash(Runs[run].Span.z));
+        vec2 jitter = vec2(random(state), random(state)) * 2.0 - 1.0;
+        float angle = random(state) * 6.2831853;
+        float speed = random(state) * Runs[run].Shape.y;
+        float shade = 0.5 + random(state);
+        outPosition = Runs[run].Origin.xy + jitter * Runs[run].Shape.x;
+        outVelocity = Runs[run].Origin.zw - vec2(cos(angle), sin(angle)) * speed;
+        outColor = vec4(Runs[run].Color.rgb * shade, 1.0);
+        outLife = Runs[run].Color.a;
+    }
+
+    float dt = Timing.x;
+    outLife -= dt;
+    if (outLife > 0.0) {
+        outPosition -= outVelocity * dt;
+        outColor.a = max(outColor.a - dt * 2.5, 0.0);
+    }
+    else
+        outColor.a = 0.0;
+}
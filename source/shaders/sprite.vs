@@ -1,12 +1,22 @@
 #version 330 core
 layout (location = 0) in vec4 vertex;
+layout (location = 1) in vec4 rect;         // position xy, size zw
+layout (location = 2) in vec4 colorRotate;  // rgb, rotation in w
+layout (location = 3) in vec4 uvRect;       // texture sub-rectangle u0 v0 u1 v1
 
 out vec2 TexCoords;
+out vec3 SpriteColor;
 
-uniform mat4 model;
 uniform mat4 projection;
 
 void main() {
-    TexCoords = vertex.zw;
-    gl_Position = projection * model * vec4(vertex.xy, 0.0, 1.0);
+    TexCoords = mix(uvRect.xy, uvRect.zw, vertex.zw);
+    SpriteColor = colorRotate.rgb;
+
+    // rotate the scaled quad about its center, then move it into place
+    vec2 local = (vertex.xy - 0.5) * rect.zw;
+    float s = sin(colorRotate.w);
+    float c = cos(colorRotate.w);
+    vec2 rotated = vec2(c * local.x - s * local.y, s * local.x + c * local.y);
+    gl_Position = projection * vec4(rotated + 0.5 * rect.zw + rect.xy, 0.0, 1.0);
 }
@@ -0,0 +1,15 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// Picks the widest vector instruction set the compiler was told it may use.
+// Kernels test BREAKOUT_SIMD_AVX first, then BREAKOUT_SIMD_SSE, and keep a
+// plain scalar loop as fallback.
+#if defined(__AVX__)
+    #define BREAKOUT_SIMD_AVX
+    #include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #define BREAKOUT_SIMD_SSE
+    #include <emmintrin.h>
+#endif
+
+#endif
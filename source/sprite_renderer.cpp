@@ -1,22 +1,26 @@
 #include <glad/glad.h>
 #include "sprite_renderer.h"
+#include "gl_state.h"
+
+#include <cstddef>
+#include <cstring>
 
 #define OPTIMIZE
 
 
-SpriteRenderer::SpriteRenderer(Shader &shader) {
+SpriteRenderer::SpriteRenderer(Shader &shader) : DrawCalls(0), stream(kSpriteStreamSize * sizeof(SpriteInstance)) {
     this->shader = shader;
     this->initRenderData();
 }
 
 SpriteRenderer::~SpriteRenderer() {
     glDeleteVertexArrays(1, &this->quadVAO);
+    glDeleteBuffers(1, &this->quadVBO);
+    GLState::Invalidate();
 }
 
 
 void SpriteRenderer::initRenderData() {
-    unsigned int VBO;
-
 #ifndef OPTIMIZE
     float vertices[] = { 
     //  position    texture
@@ -38,44 +42,102 @@ void SpriteRenderer::initRenderData() {
     };
 #endif
 
-    glGenVertexArrays(1, &this->quadVAO);
-    glGenBuffers(1, &VBO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glGenBuffers(1, &this->quadVBO);
+    GLState::BindBuffer(GL_ARRAY_BUFFER, this->quadVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
-    glBindVertexArray(this->quadVAO);
+    this->quadVAO = this->CreateInstanceArray(this->stream.ID);
+}
+
+
+unsigned int SpriteRenderer::CreateInstanceArray(unsigned int instanceBuffer) {
+    unsigned int VAO;
+    glGenVertexArrays(1, &VAO);
+
+    GLState::BindVertexArray(VAO);
+    GLState::BindBuffer(GL_ARRAY_BUFFER, this->quadVBO);
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void *)0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindVertexArray(0);
+
+    // instance attributes advance once per sprite
+    GLState::BindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    for (unsigned int attrib = 1; attrib <= 3; ++attrib) {
+        glEnableVertexAttribArray(attrib);
+        glVertexAttribDivisor(attrib, 1);
+    }
+    this->pointInstances(0);
+    return VAO;
+}
+
+
+// points the bound vertex array's instance attributes at the buffer bound to
+// GL_ARRAY_BUFFER, starting offset bytes in
+void SpriteRenderer::pointInstances(size_t offset) {
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (void *)(offset + offsetof(SpriteInstance, Rect)));
+    glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (void *)(offset + offsetof(SpriteInstance, Color)));
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(SpriteInstance), (void *)(offset + offsetof(SpriteInstance, UV)));
 }
 
 
 void SpriteRenderer::DrawSprite(Texture2D &texture, glm::vec2 position, glm::vec2 size, float rotate, glm::vec3 color) {
-    this->shader.Use();
-    glm::mat4 model = glm::mat4(1.0f);
-    model = glm::translate(model, glm::vec3(position, 0.0f));  
+    // a texture change ends the current batch
+    if (!this->instances.empty() && texture.ID != this->batchTexture.ID)
+        this->Flush();
+    if (this->instances.empty())
+        this->batchTexture = texture;
+
+    SpriteInstance instance;
+    instance.Rect = glm::vec4(position, size);
+    instance.Color = glm::vec4(color, rotate);
+    instance.UV = texture.UV;
+    this->instances.push_back(instance);
+}
 
-    model = glm::translate(model, glm::vec3(0.5f * size.x, 0.5f * size.y, 0.0f)); 
-    model = glm::rotate(model, rotate, glm::vec3(0.0f, 0.0f, 1.0f)); 
-    model = glm::translate(model, glm::vec3(-0.5f * size.x, -0.5f * size.y, 0.0f));
 
-    model = glm::scale(model, glm::vec3(size, 1.0f)); 
+void SpriteRenderer::Flush() {
+    if (this->instances.empty())
+        return;
 
-    this->shader.SetMatrix4("model", model);
-    this->shader.SetVector3f("spriteColor", color);
+    // each batch of the frame goes after the previous one in the stream buffer
+    size_t size = this->instances.size() * sizeof(SpriteInstance);
+    size_t offset;
+    void *data = this->stream.Map(size, sizeof(SpriteInstance), offset);
+    std::memcpy(data, this->instances.data(), size);
+    this->stream.Unmap();
 
-    glActiveTexture(GL_TEXTURE0);
-    texture.Bind();
+    GLState::BindVertexArray(this->quadVAO);
+    this->pointInstances(offset);
+
+    this->draw(this->batchTexture, this->quadVAO, (unsigned int)this->instances.size());
+    this->instances.clear();
+}
+
+
+void SpriteRenderer::EndFrame() {
+    this->Flush();
+    this->stream.EndFrame();
+}
 
-    glBindVertexArray(this->quadVAO);
+
+void SpriteRenderer::DrawInstances(Texture2D &texture, unsigned int instanceArray, unsigned int count) {
+    this->Flush();
+    if (count > 0)
+        this->draw(texture, instanceArray, count);
+}
+
+
+void SpriteRenderer::draw(Texture2D &texture, unsigned int VAO, unsigned int count) {
+    this->shader.Use();
+    GLState::BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    GLState::ActiveTexture(GL_TEXTURE0);
+    texture.Bind();
+    GLState::BindVertexArray(VAO);
 
 #ifndef OPTIMIZE
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, (GLsizei)count);
 #else
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)count);
 #endif
 
-    glBindVertexArray(0);
+    ++this->DrawCalls;
 }
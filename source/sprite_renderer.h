@@ -1,25 +1,63 @@
 #ifndef SPRITE_RENDERER_H
 #define SPRITE_RENDERER_H
 
+#include <vector>
+
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "texture.h"
 #include "shader.h"
+#include "stream_buffer.h"
+
+
+// sprites the instance stream holds per frame before it has to grow
+const unsigned int kSpriteStreamSize = 256;
+
+
+// per-sprite data read by sprite.vs, one entry per instance
+struct SpriteInstance {
+    glm::vec4 Rect;     // position xy, size zw
+    glm::vec4 Color;    // rgb, rotation in radians in w
+    glm::vec4 UV;       // texture sub-rectangle u0 v0 u1 v1
+};
 
 
+// Sprites are queued and drawn as instanced batches: every run of sprites
+// sharing a texture becomes one draw call. Call Flush before drawing anything
+// that does not go through this renderer so the sprites stay in order.
 class SpriteRenderer {
 public:
+    unsigned int DrawCalls;     // instanced draws issued since the last ResetStats
+
     SpriteRenderer(Shader &shader);
     ~SpriteRenderer();
 
     void DrawSprite(Texture2D &texture, glm::vec2 position, glm::vec2 size = glm::vec2(10.0f, 10.0f), float rotate = 0.0f, glm::vec3 color = glm::vec3(1.0f));
+    void Flush();
+    // flushes and retires this frame's instance data, call once after the last sprite of a frame
+    void EndFrame();
+
+    // For callers that keep their own SpriteInstance data on the GPU: makes a
+    // vertex array reading instances from instanceBuffer, and draws count of
+    // them after flushing whatever is queued.
+    unsigned int CreateInstanceArray(unsigned int instanceBuffer);
+    void DrawInstances(Texture2D &texture, unsigned int instanceArray, unsigned int count);
+
+    void ResetStats() { this->DrawCalls = 0; }
 
 private:
     Shader       shader; 
     unsigned int quadVAO;
+    unsigned int quadVBO;
+    StreamBuffer stream;        // queued instances, uploaded at every flush
+
+    std::vector<SpriteInstance> instances;
+    Texture2D                   batchTexture;
 
     void initRenderData();
+    void pointInstances(size_t offset);
+    void draw(Texture2D &texture, unsigned int VAO, unsigned int count);
 };
 
 #endif
@@ -0,0 +1,79 @@
+#include <glad/glad.h>
+
+#include "stream_buffer.h"
+#include "gl_state.h"
+
+
+StreamBuffer::StreamBuffer(size_t segmentSize, unsigned int segments)
+    : ID(0), Orphans(0), segmentSize(0), segments(segments), segment(0), cursor(0), fences(segments, nullptr) {
+    glGenBuffers(1, &this->ID);
+    this->orphan(segmentSize > 0 ? segmentSize : 1);
+    this->Orphans = 0;
+}
+
+
+StreamBuffer::~StreamBuffer() {
+    for (void *fence : this->fences)
+        if (fence)
+            glDeleteSync((GLsync)fence);
+    glDeleteBuffers(1, &this->ID);
+    GLState::Invalidate();
+}
+
+
+void *StreamBuffer::Map(size_t size, size_t alignment, size_t &offset) {
+    GLState::BindBuffer(GL_ARRAY_BUFFER, this->ID);
+
+    size_t start = (this->cursor + alignment - 1) / alignment * alignment;
+    if (start + size > this->segmentSize) {
+        // this frame outgrew its segment, start over in fresh storage that fits it
+        this->orphan(size > this->segmentSize ? size * 2 : this->segmentSize);
+        start = 0;
+    }
+    else if (this->cursor == 0 && this->fences[this->segment]) {
+        // first write to this segment since it was last drawn from
+        GLenum status = glClientWaitSync((GLsync)this->fences[this->segment], 0, 0);
+        glDeleteSync((GLsync)this->fences[this->segment]);
+        this->fences[this->segment] = nullptr;
+        if (status == GL_TIMEOUT_EXPIRED)
+            this->orphan(this->segmentSize);
+    }
+
+    offset = this->segment * this->segmentSize + start;
+    this->cursor = start + size;
+    return glMapBufferRange(GL_ARRAY_BUFFER, offset, size,
+                            GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+}
+
+
+void StreamBuffer::Unmap() {
+    GLState::BindBuffer(GL_ARRAY_BUFFER, this->ID);
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+}
+
+
+void StreamBuffer::EndFrame() {
+    if (this->cursor == 0)
+        return;
+    if (this->fences[this->segment])
+        glDeleteSync((GLsync)this->fences[this->segment]);
+    this->fences[this->segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    this->segment = (this->segment + 1) % this->segments;
+    this->cursor = 0;
+}
+
+
+// new storage for the whole ring: the driver keeps the old one alive for any
+// draw still reading it, so nothing pending needs waiting on
+void StreamBuffer::orphan(size_t segmentSize) {
+    for (void *&fence : this->fences)
+        if (fence) {
+            glDeleteSync((GLsync)fence);
+            fence = nullptr;
+        }
+    this->segmentSize = segmentSize;
+    this->cursor = 0;
+    GLState::BindBuffer(GL_ARRAY_BUFFER, this->ID);
+    glBufferData(GL_ARRAY_BUFFER, this->segmentSize * this->segments, nullptr, GL_STREAM_DRAW);
+    ++this->Orphans;
+}
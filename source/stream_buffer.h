@@ -0,0 +1,45 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <cstddef>
+#include <vector>
+
+
+const unsigned int kStreamSegments = 3;
+
+
+// A vertex buffer for data rewritten every frame. It is split into segments
+// used round-robin, one per frame. Writes go straight into unsynchronized
+// mapped memory, and a fence per segment makes sure the GPU has finished
+// reading a segment before it is written again. If the fence has not
+// signalled yet, or a frame needs more than a segment holds, the buffer is
+// orphaned instead of waiting.
+class StreamBuffer {
+public:
+    unsigned int ID;
+    unsigned int Orphans;   // times the fallback re-specified the storage
+
+    StreamBuffer(size_t segmentSize, unsigned int segments = kStreamSegments);
+    ~StreamBuffer();
+
+    StreamBuffer(const StreamBuffer &) = delete;
+    StreamBuffer &operator=(const StreamBuffer &) = delete;
+
+    // maps size bytes for writing, starting at a multiple of alignment. offset
+    // receives their byte offset in the buffer for the attribute pointers
+    void *Map(size_t size, size_t alignment, size_t &offset);
+    void  Unmap();
+
+    // call after the last draw reading this frame's writes
+    void  EndFrame();
+
+private:
+    size_t              segmentSize;
+    unsigned int        segments, segment;
+    size_t              cursor;     // bytes used in the current segment
+    std::vector<void *> fences;     // GLsync per segment, null if none pending
+
+    void orphan(size_t segmentSize);
+};
+
+#endif
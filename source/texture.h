@@ -1,6 +1,8 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
 
+#include <glm/glm.hpp>
+
 
 class Texture2D {
 public:
@@ -16,6 +18,8 @@ public:
     unsigned int Filter_Min; // filtering mode if texture pixels < screen pixels
     unsigned int Filter_Max; // filtering mode if texture pixels > screen pixels
 
+    glm::vec4    UV;         // sub-rectangle (u0, v0, u1, v1) of the GL texture, all of it unless packed into an atlas
+
     Texture2D();
 
     void Generate(unsigned int width, unsigned int height, unsigned char* data);
@@ -0,0 +1,78 @@
+#include "thread_pool.h"
+
+
+ThreadPool::ThreadPool(unsigned int threads)
+    : generation(0), busy(0), stopping(false), job(nullptr), call(nullptr), count(0), grain(1), next(0) {
+    for (unsigned int i = 1; i < threads; ++i)
+        this->workers.emplace_back(&ThreadPool::workerLoop, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->stopping = true;
+    }
+    this->wake.notify_all();
+    for (std::thread &worker : this->workers)
+        worker.join();
+}
+
+
+void ThreadPool::run(unsigned int count, unsigned int grain, const void *job, chunkCall call) {
+    if (grain == 0)
+        grain = 1;
+    if (this->workers.empty() || count <= grain) {
+        for (unsigned int begin = 0; begin < count; begin += grain)
+            call(job, begin, count - begin < grain ? count : begin + grain);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->job = job;
+        this->call = call;
+        this->count = count;
+        this->grain = grain;
+        this->next = 0;
+        this->busy = (unsigned int)this->workers.size();
+        ++this->generation;
+    }
+    this->wake.notify_all();
+
+    this->runChunks();
+
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->finished.wait(lock, [this] { return this->busy == 0; });
+    this->job = nullptr;
+}
+
+
+void ThreadPool::workerLoop() {
+    unsigned long long seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->wake.wait(lock, [&] { return this->stopping || this->generation != seen; });
+            if (this->stopping)
+                return;
+            seen = this->generation;
+        }
+
+        this->runChunks();
+
+        std::lock_guard<std::mutex> lock(this->mutex);
+        if (--this->busy == 0)
+            this->finished.notify_one();
+    }
+}
+
+
+void ThreadPool::runChunks() {
+    for (;;) {
+        unsigned int begin = this->next.fetch_add(this->grain);
+        if (begin >= this->count)
+            return;
+        unsigned int end = this->count - begin < this->grain ? this->count : begin + this->grain;
+        this->call(this->job, begin, end);
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Fixed set of worker threads for data-parallel loops. The calling thread
+// takes part in every loop, so a pool of size 1 runs everything inline.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned int threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    unsigned int Size() const { return (unsigned int)this->workers.size() + 1; }
+
+    // calls fn(begin, end) on chunks of at most grain items covering [0, count)
+    // and returns once all of them are done. fn is only referenced, never
+    // copied, so a loop allocates nothing whatever it captures
+    template <typename Fn>
+    void ParallelFor(unsigned int count, unsigned int grain, const Fn &fn) {
+        this->run(count, grain, &fn, [](const void *fn, unsigned int begin, unsigned int end) {
+            (*static_cast<const Fn *>(fn))(begin, end);
+        });
+    }
+
+private:
+    std::vector<std::thread> workers;
+
+    std::mutex               mutex;
+    std::condition_variable  wake, finished;
+    unsigned long long       generation;
+    unsigned int             busy;
+    bool                     stopping;
+
+    // the loop currently being run: call(job, begin, end) runs one chunk
+    using chunkCall = void (*)(const void *job, unsigned int begin, unsigned int end);
+    const void              *job;
+    chunkCall                call;
+    unsigned int             count, grain;
+    std::atomic<unsigned int> next;
+
+    void run(unsigned int count, unsigned int grain, const void *job, chunkCall call);
+    void workerLoop();
+    void runChunks();
+};
+
+#endif